@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <TStopwatch.h>
+#include <TString.h>
+#include <TSystem.h>
+
+#include "config.h"
+#include "entryPoints.h"
+#include "histProvider.h"
+#include "synthData.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Write a synthetic data file with every "<sample>_<mass>_<dataset>" histogram of the configuration,
+// nBins bins per sample (unless the sample is booked) and about scale entries per dataset histogram
+bool Synthesize(const char* outputFile = "dataFile.root",
+                int nBins = 50,
+                double scale = 1e4,
+                unsigned seed = 1234,
+                const char* configFile = "analysis.cfg") {
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    histProvider::closeSession(outputFile);
+    const int nWritten = writeSyntheticData(outputFile, cfg, nBins, scale, seed);
+    if (nWritten)
+        cout << "Synthesize: " << nWritten << " histograms written to " << outputFile << endl;
+    return nWritten != 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Benchmark of Graph(), NormAll() and Fit() on a synthetic data file, written to workFolder/dataFile.root,
+// so performance changes can be measured without the production files. Every entry point is run
+// nRepeats times from a cold state (no shared provider, no fit cache); the wall and CPU times are
+// printed and written to workFolder/bench.tsv, and the per-stage reports of the last repetition to
+// workFolder/<entry point>.json (or to $PERF_REPORT<entry point>.json if PERF_REPORT is set). The
+// benchmark stops at the first entry point that fails
+bool Benchmark(const char* workFolder = "bench/",
+               int nBins = 50,
+               double scale = 1e4,
+               unsigned nWorkers = 1,
+               int nRepeats = 1,
+               unsigned seed = 1234,
+               const char* configFile = "analysis.cfg") {
+
+    // The entry points read relative paths, so they are run from the work folder with the
+    // configuration given by its absolute path
+    TString config(configFile);
+    gSystem->ExpandPathName(config);
+    if (!gSystem->IsAbsoluteFileName(config))
+        config = TString(gSystem->WorkingDirectory()) + "/" + config;
+    if (gSystem->AccessPathName(config)) {
+        Error("Benchmark", "Cannot read %s", config.Data());
+        return false;
+    }
+    gSystem->mkdir(workFolder, true);
+    const string previousFolder = gSystem->WorkingDirectory();
+    if (!gSystem->ChangeDirectory(workFolder)) {
+        Error("Benchmark", "Cannot enter %s", workFolder);
+        return false;
+    }
+    const bool ownReport = !gSystem->Getenv("PERF_REPORT");
+    if (ownReport)
+        gSystem->Setenv("PERF_REPORT", "./");
+
+    const char *datafile = "dataFile.root";
+    vector<pair<string, TStopwatch>> timings;
+    auto timed = [&](const string& step, auto&& body) {
+        TStopwatch watch;
+        const bool ok = body();
+        watch.Stop();
+        if (!ok) {
+            Error("Benchmark", "%s failed", step.c_str());
+            return false;
+        }
+        timings.emplace_back(step, watch);
+        cout << "Benchmark: " << step << " took " << watch.RealTime() << " s (cpu " << watch.CpuTime() << " s)" << endl;
+        return true;
+    };
+
+    bool ok = timed("Synthesize", [&] { return Synthesize(datafile, nBins, scale, seed, config.Data()); });
+    for (int repeat = 0; ok && repeat < nRepeats; ++repeat) {
+        histProvider::closeSession(datafile);
+        ok = timed("Graph", [&] { return Graph("Plots/", datafile, nWorkers, false, config.Data(), false, "png", true); });
+        histProvider::closeSession(datafile);
+        ok = ok && timed("NormAll", [&] { return NormAll(datafile, "normFactors.tsv", config.Data(), false); });
+        histProvider::closeSession(datafile);
+        ok = ok && timed("Fit", [&] { return Fit(config.Data(), ""); });
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Summary: best and mean time of every step over the repetitions
+    map<string, vector<double>> real, cpu;
+    vector<string> steps;
+    for (auto & timing : timings) {
+        if (!real.count(timing.first))
+            steps.push_back(timing.first);
+        real[timing.first].push_back(timing.second.RealTime());
+        cpu[timing.first].push_back(timing.second.CpuTime());
+    }
+    ofstream out("bench.tsv");
+    if (!out) {
+        Error("Benchmark", "Cannot create %s/bench.tsv", workFolder);
+        ok = false;
+    }
+    out << "step\trepeats\tminReal\tmeanReal\tminCpu\tmeanCpu\n";
+    cout << "Benchmark: " << nBins << " bins, scale " << scale << ", " << nWorkers << " workers" << endl;
+    for (const auto & step : steps) {
+        const vector<double> &r = real[step], &c = cpu[step];
+        double sumReal = 0, sumCpu = 0;
+        for (size_t k = 0; k < r.size(); ++k) {
+            sumReal += r[k];
+            sumCpu  += c[k];
+        }
+        const double minReal = *min_element(r.begin(), r.end()), minCpu = *min_element(c.begin(), c.end());
+        out << step << "\t" << r.size() << "\t" << minReal << "\t" << sumReal / r.size() << "\t"
+            << minCpu << "\t" << sumCpu / c.size() << "\n";
+        printf("  %-12s best %9.3f s  mean %9.3f s  (cpu best %9.3f s)\n", step.c_str(), minReal, sumReal / r.size(), minCpu);
+    }
+
+    if (ownReport)
+        gSystem->Unsetenv("PERF_REPORT");
+    gSystem->ChangeDirectory(previousFolder.c_str());
+    return ok;
+}
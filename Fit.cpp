@@ -1,16 +1,29 @@
-#include <RooGenericPdf.h>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
 #include <RooRealVar.h>
 #include <TPaveStats.h>
-#include "datatypes.h"
+#include "config.h"
+#include "fitModel.h"
+#include "histProvider.h"
+#include "perfReport.h"
+#include "templateFit.h"
 #include <RooAddPdf.h>
+#include <RooDataHist.h>
 #include <RooPlot.h>
 #include <TCanvas.h>
 #include <TLegend.h>
 #include <TLatex.h>
 #include <TStyle.h>
+#include <TVirtualPad.h>
 #include <TFile.h>
 #include <TF1.h>
 #include <TH1.h>
+#include <TRandom3.h>
+#include "ROOT/TProcessExecutor.hxx"
+#include "ROOT/TSeq.hxx"
 
 using namespace std;
 using namespace RooFit;
@@ -22,121 +35,71 @@ using namespace RooFit;
 const string sampleName = "PtPair";
 const string mass = "RESOM";
 
-const sampleStruct selSample = samples[sampleName];
-
-// File with data
+// File with data, or a list or wildcard of files (see histCatalog.h)
 const char* datafile = "dataFile.root";
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-// DATASETS
-const dataStruct dataset[12] = {
-
-        {0, "dymumu"  ,WEIGHT_DYmumu  ,2  ,
-                "PYTHIS Low-mass Drell-Yan #mu^{+}#mu^{-}"},
-
-        {0, "dymumuL" ,WEIGHT_DYmumuL ,2  ,
-                "PYTHIA mid-mass Drell-Yan #mu^{+}#mu^{-}"},
-
-        {0, "dymumuH" ,WEIGHT_DYmumuH ,2  ,
-                "PYTHIA high-mass Drell-Yan #mu^{+}#mu^{-}"},
-
-        {0, "inelinel",WEIGHT_inelinel,419,
-                "LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (double dissociation)"},
-
-        {0, "inelel"  ,WEIGHT_inelel  ,30 ,
-                "LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (single dissociation)"},
-
-        {1, "elel"    ,WEIGHT_elel    ,800,
-                "LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (elastic)"},
-
-        {0, "inclY1S" ,WEIGHT_inclY1S ,5  ,
-                "PYTHIA/EvtGen Z2 #Upsilon(nS) #rightarrow #mu^{+}#mu^{-}"},
-
-        {0, "inclY2S" ,WEIGHT_inclY2S ,5 },
-
-        {0, "inclY3S" ,WEIGHT_inclY3S ,5 },
-
-        {1, "signal1" ,WEIGHT_signal1 ,40 ,
-                "STARLIGHT #gamma p #rightarrow#Upsilon(nS) p #rightarrow #mu^{+}#mu^{-} (elast)"},
-
-        {1, "signal2" ,WEIGHT_signal2 ,40},
-
-        {1, "signal3" ,WEIGHT_signal3 ,40}};
-
+// Title of the x-axis of a sample
+string fitTitle(const sampleStruct& sample) {
+    if (sample.unit.empty()) return sample.description + " (" + sample.unit + ")";
+    else                     return sample.description;
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-void Fit() {
-    sampleStruct sample = samples[sampleName];
+// Fit of sampleName in the selected mass region. A cacheFile (see fitCache.h) warm-starts the fit from
+// earlier results and records this one; without it every run starts from the same initial values
+bool Fit(const char* configFile = "analysis.cfg",
+         const char* cacheFile = "") {
+    perfRun run("Fit");
+    perfContext context(sampleName, mass);
+
+    // Read the datasets and the selected sample from the configuration
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> dataset = cfg.datasetsFor("Fit");
+    if (!cfg.samples.count(sampleName)) {
+        Error("Fit", "Sample %s is not in %s", sampleName.c_str(), configFile);
+        return false;
+    }
+    sampleStruct sample = cfg.samples[sampleName];
+
     // Create an output canvas
     auto *c = new TCanvas("canvas", "canvas", 1800, 1000);
     c->SetTicks();
 
-    // Read the experimental data and create a histogram out of it
-    unique_ptr<TFile> dataCluster(TFile::Open(datafile));
-    string file = sampleName + "_" + mass + "_data";
-    auto *dataHist(dataCluster->Get<TH1>(file.c_str()));
-
-    // Get the max value of the x-axis
-    Double_t upperLimit = dataHist->GetBinCenter(dataHist->GetNbinsX()) +
-                          dataHist->GetBinWidth(dataHist->GetNbinsX()) / 2;
-
-///////////////////////////////////////////////////////////////////////////////////////////////
-
-    // Create three RooFit variables, one generic and two that will hold the fitting values
-    const char *title;
-    if (sample.unit.empty()) title = string(sample.description + " (" + sample.unit + ")").c_str();
-    else                     title = string(sample.description).c_str();
-    RooRealVar x("x", title, 0, upperLimit);
-
-    // Create two empty histograms that hold the exclusive and dissociative data
-    auto excHist = new TH1F("excHist", "Exclusive", dataHist->GetNbinsX(), 0, upperLimit);
-    auto disHist = new TH1F("disHist", "Dissociative", dataHist->GetNbinsX(), 0, upperLimit);
-
-    // Fill the histograms
-    for (const dataStruct& simData : dataset) {
-        file = sampleName + "_" + mass + "_" + simData.name;
-        auto h =dataCluster->Get<TH1>(file.c_str());
-        h->Scale(simData.weight);
-        if (simData.isUsed == 0)
-            disHist->Add(h);
-        else
-            excHist->Add(h);
+    // Read the experimental data and the exclusive and dissociative templates
+    histProvider &provider = histProvider::session(datafile);
+    if (!provider.isOpen())
+        return false;
+    provider.setViews(cfg.samples);
+    fitInputs in;
+    if (!readFitInputs(provider, sampleName, mass, dataset, in)) {
+        Error("Fit", "Histogram %s_%s_data not found in %s", sampleName.c_str(), mass.c_str(), datafile);
+        return false;
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Convert the TH1 histograms to RooFit histograms
-    RooDataHist data("data", "Experimental data", x, dataHist);
-    RooDataHist exc("exc", "Exclusive fit", x, excHist);
-    RooDataHist dis("dis", "Dissociative fit", x, disHist);
-
-    // Create parameters variables
-    RooRealVar excA("excA", "exclusive A value", 1, 0, 10000);
-    RooRealVar excB("excB", "exclusive B value", 1, 0, 100);
-    RooRealVar disA("disA", "dissociative A value", 1, 0, 10000);
-    RooRealVar disB("disB", "dissociative B value", 1, 0, 100);
-
-    // Create two fit templates
-    RooGenericPdf excFit("excFit", "excFit", "x*exp(-excB*x*x)",
-                         RooArgSet(x, excB));
-    RooGenericPdf disFit("disFit", "disFit", "x*exp(-disB*x*x)",
-                         RooArgSet(x, disB));
-
-    // fit them to the histograms, defining the "B" parameter
-    disFit.fitTo(dis, PrintLevel(-1));
-    excFit.fitTo(exc, PrintLevel(-1));
-
-    // Create a new PDF that's the sum of the other 2 fitted
-    RooAddPdf finalPDF("finalPDF", "finalPDF", RooArgList(excFit, disFit),
-                       RooArgList(excA, disA));
-    finalPDF.fitTo(data, PrintLevel(-1));
+    // Create the RooFit variables and the two x*exp(-B*x*x) templates, fit each template to its
+    // histogram and then their sum to the data. If this fit is in the cache, start from its result
+    fitCache cache(cacheFile);
+    const string hash = hashFitInputs(in).str();
+    const fitStart *start = cache.find(sampleName, mass, hash);
+    fitModel model(fitTitle(sample).c_str(), in.upperLimit);
+    if ((start ? model.fit(in, *start) : model.fit(in)) == 0) {
+        cache.store(sampleName, mass, hash, model.snapshot());
+        cache.save();
+    }
+    RooRealVar  &x        = model.x;
+    RooAddPdf   &finalPDF = model.finalPDF;
+    RooDataHist &data     = *model.data;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
     // Create a function that has the fitting parameters
-    auto *function = new TF1("finalFunc", "[0]*x*exp(-[1]*x*x) + [2]*x*exp(-[3]*x*x)", 0, 5);
     auto *f2 = new TF1("f2", "[0]*x*exp(-[1]*x*x)", 0, 5);
     auto *leg1 = new TLegend(0.60,0.75,0.85,0.88);
     leg1->SetTextSize(0.025);
@@ -157,17 +120,9 @@ void Fit() {
     // Variable that holds the fit results and errors
     double par[4][2];
 
-    // Setup variable values
-    f2->SetParameters(1,disB.getVal());
-    par[0][0] = disA.getVal() / (f2->Integral(0, 2) * 10);
-    par[0][1] = disA.getError() / (f2->Integral(0, 2) * 10);
-    par[1][0] = disB.getVal();
-    par[1][1] = disB.getError();
-    f2->SetParameters(1, excB.getVal());
-    par[2][0] = excA.getVal() / (f2->Integral(0, 2) * 10);
-    par[2][1] = excA.getError() / (f2->Integral(0, 2) * 10);
-    par[3][0] = excB.getVal();
-    par[3][1] = excB.getError();
+    // Setup variable values, with the integral and mean of the fitted function computed analytically
+    model.results(par);
+    const fitDerived quantities = model.derived();
 
     // Draw dissociative fit
     f2->SetParameters(par[0][0], par[1][0]);
@@ -196,16 +151,10 @@ void Fit() {
     stats->SetY2NDC(0.95);
     stats->SetTextSize(0.025);
 
-    // Set model function parameters
-    function->SetParameter(0, par[0][0]);
-    function->SetParameter(1, par[1][0]);
-    function->SetParameter(2, par[2][0]);
-    function->SetParameter(3, par[3][0]);
-
     // Set up the statistics window.
     stats->AddText("Results");
-    stats->AddText(("Integral = " + to_string(function->Integral(0,3)*10)).c_str());
-    stats->AddText(("Mean = " + to_string(function->Mean(0,3))).c_str());
+    stats->AddText(("Integral = "+to_string(quantities.integral.value)+" #pm "+to_string(quantities.integral.error).substr(0,5)).c_str());
+    stats->AddText(("Mean = "+to_string(quantities.mean.value)+" #pm "+to_string(quantities.mean.error).substr(0,5)).c_str());
     auto *text = new TLatex();
     text->SetText(0,0,"±");
     stats->AddText(("Dis. A = "+to_string(par[0][0]).substr(0,5)+" #pm "+to_string(par[0][1]).substr(0,5)).c_str());
@@ -218,5 +167,407 @@ void Fit() {
 
     // Save the plot
     c->SaveAs("./fitSplitHist.png");
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
 
-}
\ No newline at end of file
+// Fit campaign: the exclusive/dissociative fit of every PtPair* sample in every mass region, with the
+// nominal weights and with every weight variation of the configuration. The fits are spread over a
+// pool of worker processes, each fit with its own RooFit objects, and the par[4][2] results of all of
+// them are written to one table
+bool FitScan(const char* datafile = "dataFile.root",
+             const char* outputFile = "fitScan.tsv",
+             unsigned nWorkers = 4,
+             const char* configFile = "analysis.cfg",
+             const char* cacheFile = "") {
+    perfRun run("FitScan");
+
+    // Read the datasets, samples, mass regions and weight variations
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> dataset = cfg.datasetsFor("Fit");
+    vector<weightVariation> variations = {{"nominal", {}}};
+    variations.insert(variations.end(), cfg.variations.begin(), cfg.variations.end());
+
+    // List every fit to be done
+    struct fitJob { string sample, mass; size_t variation; };
+    vector<fitJob> jobs;
+    for (const auto & j : cfg.samples) {
+        if (j.first.rfind("PtPair", 0) != 0) continue;
+        for (const auto & mass : cfg.massList)
+            for (size_t v = 0; v < variations.size(); ++v)
+                jobs.push_back({j.first, mass, v});
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Previous results, read before the workers start so every worker has a copy
+    fitCache cache(cacheFile);
+
+    // Worker w does the fits w, w + nWorkers, ... and returns, for each of them, the job index, the fit
+    // status, the 8 values of par[4][2], the integral and mean with their errors, the fitted parameters
+    // and errors and the inputs hash (split in two 32-bit halves, so it is exactly representable as doubles).
+    // A worker that can't open the data file returns a single -1 instead
+    const int parOffset = 2, startOffset = 14, hashOffset = 22, rowSize = 24;
+    if (nWorkers < 1) nWorkers = 1;
+    auto fitWorker = [&](unsigned worker) {
+        vector<double> rows;
+
+        // Each worker opens its own file handle, since they can't be shared between processes. The
+        // histograms of the datasets a variation doesn't scale are reused from the previous fits
+        if (nWorkers > 1) perfReport::global().startWorker();
+        histProvider provider(datafile);
+        if (!provider.isOpen())
+            return vector<double>{-1};
+        provider.setViews(cfg.samples);
+
+        for (size_t k = worker; k < jobs.size(); k += nWorkers) {
+            const fitJob &job = jobs[k];
+            perfContext context(job.sample, job.mass);
+            fitInputs in;
+            if (!readFitInputs(provider, job.sample, job.mass, dataset, in,
+                               variations[job.variation].datasetScales(dataset)))
+                continue;
+
+            // Start from the cached result of this fit, or of the same sample and mass region
+            const uint64_t hash = hashFitInputs(in).get();
+            const fitStart *start = cache.find(job.sample, job.mass, inputHash::hex(hash));
+            fitModel model(fitTitle(cfg.samples[job.sample]).c_str(), in.upperLimit);
+            const int status = start ? model.fit(in, *start) : model.fit(in);
+            const fitDerived quantities = model.derived();
+            const fitStart result = model.snapshot();
+
+            rows.push_back(k);
+            rows.push_back(status);
+            for (const auto & p : quantities.par) {
+                rows.push_back(p.value);
+                rows.push_back(p.error);
+            }
+            for (const auto & q : {quantities.integral, quantities.mean}) {
+                rows.push_back(q.value);
+                rows.push_back(q.error);
+            }
+            for (int p = 0; p < 4; ++p) {
+                rows.push_back(result.value[p]);
+                rows.push_back(result.error[p]);
+            }
+            rows.push_back(double(hash >> 32));
+            rows.push_back(double(hash & 0xffffffffULL));
+        }
+        if (nWorkers > 1) perfReport::global().saveFragment(worker);
+        return rows;
+    };
+
+    vector<vector<double>> results;
+    if (nWorkers == 1)
+        results.push_back(fitWorker(0));
+    else {
+        ROOT::TProcessExecutor pool(nWorkers);
+        results = pool.Map(fitWorker, ROOT::TSeqU(nWorkers));
+        perfReport::global().mergeFragments(nWorkers);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Gather the results in job order. A worker without the data file has already reported the error
+    vector<const double*> rowOf(jobs.size(), nullptr);
+    for (const auto & rows : results)
+        if (rows.size() % rowSize != 0)
+            return false;
+    for (const auto & rows : results)
+        for (size_t r = 0; r + rowSize <= rows.size(); r += rowSize)
+            rowOf[size_t(rows[r])] = &rows[r];
+
+    ofstream out(outputFile);
+    if (!out) {
+        Error("FitScan", "Cannot create %s", outputFile);
+        return false;
+    }
+    out << "sample\tmass\tvariation\tstatus\tdisA\tdisAErr\tdisB\tdisBErr\texcA\texcAErr\texcB\texcBErr"
+        << "\tintegral\tintegralErr\tmean\tmeanErr\n";
+    int nFits = 0;
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        if (!rowOf[k]) continue;
+        out << jobs[k].sample << "\t" << jobs[k].mass << "\t" << variations[jobs[k].variation].name;
+        out << "\t" << int(rowOf[k][1]);
+        for (int p = parOffset; p < startOffset; ++p)
+            out << "\t" << rowOf[k][p];
+        out << "\n";
+        ++nFits;
+
+        // Cache the converged fits
+        if (rowOf[k][1] != 0) continue;
+        fitStart result;
+        for (int p = 0; p < 4; ++p) {
+            result.value[p] = rowOf[k][startOffset + 2 * p];
+            result.error[p] = rowOf[k][startOffset + 2 * p + 1];
+        }
+        const uint64_t hash = (uint64_t(rowOf[k][hashOffset]) << 32) | uint64_t(rowOf[k][hashOffset + 1]);
+        cache.store(jobs[k].sample, jobs[k].mass, inputHash::hex(hash), result);
+    }
+    cache.save();
+    out.close();
+    if (!out) {
+        Error("FitScan", "Cannot write %s", outputFile);
+        return false;
+    }
+    cout << "FitScan: " << nFits << " of " << jobs.size() << " fits written to " << outputFile << endl;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Toy study of the fit of sampleName in the selected mass region: nToys Poisson fluctuations of the data
+// are refitted with the same model, starting from the result of the nominal fit. The toys are
+// spread over a pool of worker processes. Every worker allocates one model and one toy RooDataHist and
+// reuses them for all its toys, and toy i is drawn from its own random stream seeded with (seed, i), so
+// the results don't depend on the number of workers. The spread, pull and coverage of every parameter
+// are written to a table
+bool FitToys(int nToys = 10000,
+             unsigned nWorkers = 4,
+             unsigned seed = 1234,
+             const char* outputFile = "fitToys.tsv",
+             const char* configFile = "analysis.cfg",
+             const char* cacheFile = "") {
+    perfRun run("FitToys");
+    perfContext context(sampleName, mass);
+
+    // Read the datasets and the selected sample from the configuration
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> dataset = cfg.datasetsFor("Fit");
+    if (!cfg.samples.count(sampleName)) {
+        Error("FitToys", "Sample %s is not in %s", sampleName.c_str(), configFile);
+        return false;
+    }
+    const string title = fitTitle(cfg.samples[sampleName]);
+
+    // Read the experimental data and the exclusive and dissociative templates
+    histProvider &provider = histProvider::session(datafile);
+    if (!provider.isOpen())
+        return false;
+    provider.setViews(cfg.samples);
+    fitInputs in;
+    if (!readFitInputs(provider, sampleName, mass, dataset, in)) {
+        Error("FitToys", "Histogram %s_%s_data not found in %s", sampleName.c_str(), mass.c_str(), datafile);
+        return false;
+    }
+
+    // Nominal fit, warm-started from the cache if one is given. Its result is the reference value of the toys and
+    // the starting point of every toy fit
+    fitCache cache(cacheFile);
+    const string hash = hashFitInputs(in).str();
+    const fitStart *cached = cache.find(sampleName, mass, hash);
+    fitModel nominal(title.c_str(), in.upperLimit);
+    const int nominalStatus = cached ? nominal.fit(in, *cached) : nominal.fit(in);
+    if (nominalStatus != 0)
+        Warning("FitToys", "Nominal fit ended with status %d", nominalStatus);
+    else {
+        cache.store(sampleName, mass, hash, nominal.snapshot());
+        cache.save();
+    }
+    const fitStart start = nominal.snapshot();
+    const double *truth = start.value, *truthError = start.error;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Worker w fits the toys w, w + nWorkers, ... and returns, for each of them, the toy index, the fit
+    // status and the value and error of the 4 parameters
+    const int rowSize = 10;
+    if (nWorkers < 1) nWorkers = 1;
+    auto toyWorker = [&](unsigned worker) {
+        if (nWorkers > 1) perfReport::global().startWorker();
+        vector<double> rows;
+        rows.reserve((nToys / nWorkers + 1) * rowSize);
+
+        // Model, toy histogram and random generator allocated once and reused for every toy
+        fitModel model(title.c_str(), in.upperLimit);
+        auto params = model.parameters();
+        RooDataHist toyData("toyData", "Toy data", model.x, in.data.get());
+        const int nBins = in.data->GetNbinsX();
+        TRandom3 rng;
+
+        for (int toy = worker; toy < nToys; toy += nWorkers) {
+
+            // Poisson fluctuation of every bin of the data
+            rng.SetSeed(ULong_t(seed) * 1000003UL + toy + 1);
+            for (int bin = 0; bin < nBins; ++bin) {
+                const double n = rng.Poisson(in.data->GetBinContent(bin + 1));
+                toyData.set(bin, n, sqrt(n));
+            }
+
+            // Refit, starting from the nominal result
+            model.setStart(start);
+            const int status = model.fitData(toyData);
+
+            rows.push_back(toy);
+            rows.push_back(status);
+            for (auto *p : params) {
+                rows.push_back(p->getVal());
+                rows.push_back(p->getError());
+            }
+        }
+        if (nWorkers > 1) perfReport::global().saveFragment(worker);
+        return rows;
+    };
+
+    vector<vector<double>> results;
+    if (nWorkers == 1)
+        results.push_back(toyWorker(0));
+    else {
+        ROOT::TProcessExecutor pool(nWorkers);
+        results = pool.Map(toyWorker, ROOT::TSeqU(nWorkers));
+        perfReport::global().mergeFragments(nWorkers);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Summaries over the converged toys. The pull is (toy value - nominal value) / toy error and the
+    // coverage is the fraction of toys whose +-1 error interval contains the nominal value
+    double sum[4] = {}, sum2[4] = {}, pullSum[4] = {}, pullSum2[4] = {}, covered[4] = {};
+    int nConverged = 0;
+    for (const auto & rows : results) {
+        for (size_t r = 0; r + rowSize <= rows.size(); r += rowSize) {
+            if (rows[r + 1] != 0) continue;
+            ++nConverged;
+            for (int k = 0; k < 4; ++k) {
+                const double value = rows[r + 2 + 2 * k], error = rows[r + 3 + 2 * k];
+                const double pull  = error > 0 ? (value - truth[k]) / error : 0;
+                sum[k]      += value;
+                sum2[k]     += value * value;
+                pullSum[k]  += pull;
+                pullSum2[k] += pull * pull;
+                covered[k]  += fabs(pull) < 1;
+            }
+        }
+    }
+    if (nConverged == 0) {
+        Error("FitToys", "None of the %d toy fits converged", nToys);
+        return false;
+    }
+
+    const char* names[4] = {"disA", "disB", "excA", "excB"};
+    ofstream out(outputFile);
+    if (!out) {
+        Error("FitToys", "Cannot create %s", outputFile);
+        return false;
+    }
+    out << "parameter\tnominal\tnominalErr\ttoyMean\ttoyRMS\tpullMean\tpullWidth\tcoverage\n";
+    for (int k = 0; k < 4; ++k) {
+        const double mean     = sum[k] / nConverged;
+        const double pullMean = pullSum[k] / nConverged;
+        out << names[k] << "\t" << truth[k] << "\t" << truthError[k]
+            << "\t" << mean << "\t" << sqrt(max(0., sum2[k] / nConverged - mean * mean))
+            << "\t" << pullMean << "\t" << sqrt(max(0., pullSum2[k] / nConverged - pullMean * pullMean))
+            << "\t" << covered[k] / nConverged << "\n";
+    }
+    out.close();
+    if (!out) {
+        Error("FitToys", "Cannot write %s", outputFile);
+        return false;
+    }
+    cout << "FitToys: " << nConverged << " of " << nToys << " toy fits converged, summary written to "
+         << outputFile << endl;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Binned template fit of sampleName in the selected mass region: every dataset group of the
+// configuration becomes one template (the sum of its weighted histograms) with a free normalization,
+// the datasets outside any group are kept fixed at their weights. The normalizations, their errors
+// and the nominal and fitted yields of every group are written to a table
+bool TemplateFit(const char* outputFile = "templateFit.tsv",
+                 const char* configFile = "analysis.cfg") {
+    perfRun run("TemplateFit");
+    perfContext context(sampleName, mass);
+
+    // Read the datasets and their groups from the configuration
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    if (cfg.groups.empty()) {
+        Error("TemplateFit", "No dataset group in %s", configFile);
+        return false;
+    }
+    const unsigned nTemplates = cfg.groups.size();
+    map<string, unsigned> groupOf;
+    vector<string> names;
+    for (unsigned t = 0; t < nTemplates; ++t) {
+        names.push_back(cfg.groups[t].name);
+        for (const auto & name : cfg.groups[t].datasets)
+            groupOf[name] = t;
+    }
+
+    // Read the experimental data
+    histProvider &provider = histProvider::session(datafile);
+    if (!provider.isOpen())
+        return false;
+    provider.setViews(cfg.samples);
+    auto dataHist = provider.get(sampleName, mass, "data");
+    if (!dataHist) {
+        Error("TemplateFit", "Histogram %s_%s_data not found in %s", sampleName.c_str(), mass.c_str(), datafile);
+        return false;
+    }
+    const int nBins = dataHist->GetNbinsX();
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Fill the bins x templates matrix with the weighted dataset histograms
+    vector<double> matrix(size_t(nBins) * nTemplates, 0.), fixed(nBins, 0.);
+    for (const auto & data : cfg.datasets) {
+        auto h = provider.get(sampleName, mass, data.name, data.weight);
+        if (!h) {
+            Warning("TemplateFit", "Histogram %s_%s_%s not found, skipped", sampleName.c_str(), mass.c_str(),
+                    data.name.c_str());
+            continue;
+        }
+        if (h->GetNbinsX() != nBins) {
+            Error("TemplateFit", "Histogram %s_%s_%s has %d bins instead of %d", sampleName.c_str(), mass.c_str(),
+                  data.name.c_str(), h->GetNbinsX(), nBins);
+            return false;
+        }
+        auto group = groupOf.find(data.name);
+        for (int bin = 0; bin < nBins; ++bin) {
+            const double content = h->GetBinContent(bin + 1);
+            if (group != groupOf.end()) matrix[size_t(bin) * nTemplates + group->second] += content;
+            else                        fixed[bin] += content;
+        }
+    }
+
+    templateLikelihood nll(nTemplates);
+    for (int bin = 0; bin < nBins; ++bin)
+        nll.addBin(dataHist->GetBinContent(bin + 1), fixed[bin], &matrix[size_t(bin) * nTemplates]);
+    perfTimer minimizeTimer("minimize");
+    const templateResult result = minimizeTemplates(nll, names);
+    minimizeTimer.stop();
+    if (result.status != 0)
+        Warning("TemplateFit", "Minimization ended with status %d", result.status);
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    ofstream out(outputFile);
+    if (!out) {
+        Error("TemplateFit", "Cannot create %s", outputFile);
+        return false;
+    }
+    out << "group\tmu\tmuErr\tnominalYield\tfittedYield\n";
+    for (unsigned t = 0; t < nTemplates; ++t) {
+        double yield = 0;
+        for (int bin = 0; bin < nBins; ++bin)
+            yield += matrix[size_t(bin) * nTemplates + t];
+        out << names[t] << "\t" << result.mu[t] << "\t" << result.error[t]
+            << "\t" << yield << "\t" << yield * result.mu[t] << "\n";
+    }
+    out.close();
+    if (!out) {
+        Error("TemplateFit", "Cannot write %s", outputFile);
+        return false;
+    }
+    cout << "TemplateFit: " << nTemplates << " templates fitted in " << nll.bins() << " bins (status "
+         << result.status << "), results written to " << outputFile << endl;
+    return true;
+}
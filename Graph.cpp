@@ -1,138 +1,400 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
 #include <TSystem.h>
+#include <TROOT.h>
+#include "ROOT/TProcessExecutor.hxx"
+#include "ROOT/TSeq.hxx"
 #include "TF1.h"
 #include "TH1.h"
+#include "TH2D.h"
 #include "TFile.h"
 #include "THStack.h"
 #include "TCanvas.h"
 #include "TLegend.h"
-#include "TTreeReaderArray.h"
 
-#include "datatypes.h"
+#include "config.h"
+#include "histProvider.h"
+#include "inputHash.h"
+#include "perfReport.h"
+#include "plotCache.h"
+#include "plotEnvelope.h"
+#include "plotOutput.h"
+#include "plotScope.h"
+#include "stackCache.h"
 
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-// Datasets
-const dataStruct dataset[12] = {
-        {1, "dymumu"  , WEIGHT_DYmumu  , 2   , "PYTHIS Low-mass Drell-Yan #mu^{+}#mu^{-}"},
-        {1, "dymumuL" , WEIGHT_DYmumuL , 2   , "PYTHIA mid-mass Drell-Yan #mu^{+}#mu^{-}"},
-        {1, "dymumuH" , WEIGHT_DYmumuH , 2   , "PYTHIA high-mass Drell-Yan #mu^{+}#mu^{-}"},
-        {1, "inelinel", WEIGHT_inelinel, 419 , "LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (double dissociation)"},
-        {1, "inelel"  , WEIGHT_inelel  , 30  , "LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (single dissociation)"},
-        {1, "elel"    , WEIGHT_elel    , 800 , "LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (elastic)"},
-        {1, "inclY1S" , WEIGHT_inclY1S , 5   , "PYTHIA/EvtGen Z2 #Upsilon(nS) #rightarrow #mu^{+}#mu^{-}"},
-        {1, "inclY2S" , WEIGHT_inclY2S , 5  },
-        {1, "inclY3S" , WEIGHT_inclY3S , 5  },
-        {1, "signal1" , WEIGHT_signal1 , 40  , "STARLIGHT #gamma p #rightarrow#Upsilon(nS) p #rightarrow #mu^{+}#mu^{-} (elast)"},
-        {1, "signal2" , WEIGHT_signal2 , 40 },
-        {1, "signal3" , WEIGHT_signal3 , 40}};
+// Histogram of the stack with its fill color and legend
+struct stackLayer {
+    TH1*        hist;
+    Color_t     color;
+    string      legend;
+};
+
+// Draw the data and the stack of a single (mass region, sample) plot on the given canvas and save it in
+// outputFolder/mass/. The histograms are owned by the scope of the caller. Returns false, after removing
+// the previous output of the plot, if there is nothing to draw
+bool composePlot(TCanvas* c, plotScope& scope, TH1* expData, const vector<stackLayer>& layers,
+                 plotOutput& output, const string& mass, const string& sampleName, const sampleStruct& sample) {
+
+    // If the samples have a logarithmic scale, apply it in the canvas
+    if (sample.log)
+        c->SetLogy();
+    else
+        c->SetLogy(false);
+
+    // Config legend proprieties
+    auto legend = scope.make<TLegend>(0.45,.68,.88,0.87);
+    legend->SetBorderSize(0);
+    legend->SetTextSize(0.027);
+    THStack *histStack;
+    if (sample.unit.empty()) histStack = scope.make<THStack>(sample.title.c_str(),
+                                                             string(sampleName + "_" + mass + ";" + sample.description + " (" + sample.unit + ")").c_str());
+    else histStack = scope.make<THStack>(sample.title.c_str(),
+                                         string(sampleName + "_" + mass + ";" + sample.description).c_str());
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-// Mass Regions
-const string massList[9]  = {"LOWMM","RESOM","HIGHM","SIDEB","FULLM","EXTMM","ZPEAK","LARGE","HIGGS"};
+    perfTimer timer("draw");
+
+    // The integrals, the stacked sum and the ranges are accumulated while the plot is composed
+    plotEnvelope envelope;
+    envelope.setData(*expData);
+
+    // If the experimental data exists, personalize it and add a legend`s entry for it
+    if (envelope.hasData()) {
+        expData->SetMarkerStyle(20);
+        expData->SetLineColor(kBlack);
+        legend->AddEntry(expData, "Data", "lp");
+    }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-// Main function receives the output folder and file to read the data
-void Graph(const string& outputFolder = "./Plots/",
-           const char* datafile = "dataFile.root") {
+    // Create a stack of histograms containing the generated datasets
+    for (const auto & layer : layers) {
+        TH1 *h = layer.hist;
 
-    // Create output folder
-    gSystem->mkdir(outputFolder.c_str());
+        // If the histogram is empty, skit it
+        if (!envelope.addLayer(*h)) continue;
+
+        // Personalize the histogram
+        h->SetLineColor(kBlack);
+        h->SetFillColor(layer.color);
 
-    // Create canvas with ticks
-    auto *c = new TCanvas("canvas", "canvas", 1800, 1000);
-    c->SetTicks();
-
-    // Loop through all simulated mass regions and samples
-    for (const auto & i : massList){
-        for(const auto & j : samples){
-            sampleStruct sample = j.second;
-
-            // If the samples have a logarithmic scale, apply it in the canvas
-            if (sample.log)
-                c->SetLogy();
-            else
-                c->SetLogy(false);
-
-            // Create output directory
-            string location = outputFolder + i + "/";
-            gSystem->mkdir(location.c_str());
-
-            // Config legend proprieties
-            auto legend = new TLegend(0.45,.68,.88,0.87);
-            legend->SetBorderSize(0);
-            legend->SetTextSize(0.027);
-            THStack *histStack;
-            if (sample.unit.empty()) histStack = new THStack(sample.title.c_str(),
-                                                             string(j.first + "_" + i + ";" + sample.description + " (" + sample.unit + ")").c_str());
-            else histStack = new THStack(sample.title.c_str(),
-                                         string(j.first + "_" + i + ";" + sample.description).c_str());
+        // Add a legend to the histogram (if its needed)
+        if (!layer.legend.empty())
+            legend->AddEntry(h, layer.legend.c_str(), "f");
+
+        // Add the histogram to a stack
+        histStack->Add(h);
+    }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-            // Get the experimental data
-            unique_ptr<TFile> dataCluster(TFile::Open(datafile));
-            string file = j.first + "_" + i + "_" + "data";
-            auto *expData(dataCluster->Get<TH1>(file.c_str()));
+    // Check if there is any data to be drawn
+    const double stackMax = envelope.stackMaximum();
+    const bool flatStack = stackMax == envelope.stackMinimum(sample.log);
+    if (flatStack && !envelope.hasData()) {
+        output.discard(mass, sampleName + "_" + mass);
+        return false;
+    }
 
-            // If the experimental data exists, personalize it and add a legend`s entry for it
-            if (expData->Integral() != 0) {
-                expData->SetMarkerStyle(20);
-                expData->SetLineColor(kBlack);
-                legend->AddEntry(expData, "Data", "lp");
-            }
+    // If there is, check if either the expeimental or the generated data is empty and print only one histogram
+    else if (flatStack) {
+        //expData->SetStats(0);
+        expData->Draw("");
+    } else if (!envelope.hasData())
+        histStack->Draw("HIST");
+
+    // If both histograms have data, then draw both
+    else {
+        if (stackMax < envelope.dataTop())
+            histStack->SetMaximum(envelope.dataTop());
+        histStack->Draw("HIST");
+        expData  ->Draw("e1x0p SAME");
+    }
+
+    // Draw the legend and plot the graph
+    legend->Draw("SAME");
+    timer.stop();
+    output.save(c, mass, sampleName + "_" + mass);
+    return true;
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-            // Create a stack of histograms containing the generated datasets
-            for (const auto & data : dataset) {
-                if (data.isUsed == 0) continue;
-                file = j.first + "_" + i + "_" + data.name;
-                TH1 *h(dataCluster->Get<TH1>(file.c_str()));
+// Draw a plot from the histograms of the data file, scaling every dataset by its weight. Returns false if
+// the plot was not saved, e.g. without its data histogram
+bool drawPlot(TCanvas* c, histProvider& provider, const vector<dataStruct>& dataset,
+              plotOutput& output, const string& mass, const string& sampleName, const sampleStruct& sample) {
 
-                // If the histogram is empty, skit it
-                if (h->Integral() == 0) continue;
+    // Every stage of this plot is attributed to its sample and mass region
+    perfContext context(sampleName, mass);
 
-                // Personalize the histogram
-                h->SetLineColor(kBlack);
-                h->Scale(data.weight);
-                h->SetFillColor(data.color);
+    // Every object created for this plot is owned by the scope and released after the plot is saved
+    plotScope scope(c);
 
-                // Add a legend to the histogram (if its needed)
-                if (!data.legend.empty())
-                    legend->AddEntry(h, data.legend.c_str(), "f");
+    // Get the experimental data
+    auto *expData(scope.adopt(provider.copy(sampleName, mass, "data")));
+    if (!expData) {
+        output.discard(mass, sampleName + "_" + mass);
+        return false;
+    }
 
-                // Add the histogram to a stack
-                histStack->Add(h);
-            }
+    // Get the generated datasets, already scaled by their weights
+    vector<stackLayer> layers;
+    for (const auto & data : dataset) {
+        if (data.isUsed == 0) continue;
+        TH1 *h(scope.adopt(provider.copy(sampleName, mass, data.name, data.weight)));
+        if (!h) continue;
+        layers.push_back({h, data.color, data.legend});
+    }
+
+    return composePlot(c, scope, expData, layers, output, mass, sampleName, sample);
+}
+
+// Draw a plot from the pre-weighted and pre-stacked cache, with a single read. Only the components whose
+// datasets are all used are drawn
+bool drawPlot(TCanvas* c, const stackCache& stacks, const set<string>& unused,
+              plotOutput& output, const string& mass, const string& sampleName, const sampleStruct& sample) {
+
+    // Every stage of this plot is attributed to its sample and mass region
+    perfContext context(sampleName, mass);
+
+    // Every object created for this plot is owned by the scope and released after the plot is saved
+    plotScope scope(c);
+
+    unique_ptr<TH2D> packed(stacks.get(sampleName, mass));
+    if (!packed) {
+        output.discard(mass, sampleName + "_" + mass);
+        return false;
+    }
+    auto *expData(scope.adopt(stackCache::row(*packed, 0, sampleName + "_" + mass + "_data")));
+
+    vector<stackLayer> layers;
+    for (size_t k = 0; k < stacks.stack().size(); ++k) {
+        const stackComponent &component = stacks.stack()[k];
+        if (unused.count(component.name)) continue;
+        TH1 *h(scope.adopt(stackCache::row(*packed, k + 1, sampleName + "_" + mass + "_" + component.name)));
+        layers.push_back({h, component.color, component.legend});
+    }
+
+    return composePlot(c, scope, expData, layers, output, mass, sampleName, sample);
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-            // Check if there is any data to be drawn
-            if (histStack->GetMaximum() == histStack->GetMinimum() && expData->Integral() == 0)
+// Hash of everything a plot depends on: the sample configuration, the dataset configuration, the
+// stack components in stacked mode (none otherwise) and the contents of every histogram drawn in it
+string plotHash(histProvider& provider, const vector<dataStruct>& dataset, const vector<stackComponent>& components,
+                const string& mass, const string& sampleName, const sampleStruct& sample) {
+    inputHash hash;
+    hash.add(sampleName).add(mass);
+    hash.add(sample.title).add(sample.description).add(sample.unit).add(sample.log);
+
+    auto expData = provider.get(sampleName, mass, "data");
+    hash.add(expData.get());
+
+    for (const auto & data : dataset) {
+        if (data.isUsed == 0) continue;
+        auto h = provider.get(sampleName, mass, data.name);
+        hash.add(data.name).add(data.weight).add(int(data.color)).add(data.legend).add(h.get());
+    }
+    for (const auto & component : components)
+        hash.add(component.name).add(int(component.color)).add(component.legend);
+    return hash.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Main function receives the output folder, the data file (or a comma separated list or wildcard of files,
+// e.g. one per dataset, see histCatalog.h) and the configuration file. With nWorkers > 1 the plots
+// are rendered by a pool of worker processes, each one with its own canvas and its own read-only
+// view of the data file. Parallel runs force batch mode, so they match a serial run done with "root -b".
+// In incremental mode only the plots whose inputs changed since the previous run are drawn again. In stacked
+// mode every plot is a single read of the pre-weighted stack cache: each dataset group is drawn as one
+// block, with the legend of its "group" line (or its name), instead of one outlined block per dataset.
+// The plots are written as png (encoded by a background thread), svg or one multi-page pdf per mass
+// region; headless forces batch mode, so no canvas is ever shown on screen
+bool Graph(const string& outputFolder = "./Plots/",
+           const char* datafile = "dataFile.root",
+           unsigned nWorkers = 1,
+           bool incremental = false,
+           const char* configFile = "analysis.cfg",
+           bool stacked = false,
+           const char* format = "png",
+           bool headless = false) {
+    perfRun run("Graph");
+
+    plotFormat outputFormat;
+    if (!parsePlotFormat(format, outputFormat)) {
+        Error("Graph", "Unknown output format %s, expected png, svg or pdf", format);
+        return false;
+    }
+    if (headless)
+        gROOT->SetBatch(true);
+
+    // Read the datasets, samples and mass regions
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> dataset = cfg.datasetsFor("Graph");
+    const vector<string>& massList = cfg.massList;
+    map<string, sampleStruct>& samples = cfg.samples;
+
+    // Create output folder and one directory per mass region
+    gSystem->mkdir(outputFolder.c_str());
+    for (const auto & i : massList)
+        gSystem->mkdir((outputFolder + i + "/").c_str());
+
+    // List every (mass region, sample) plot to be drawn
+    vector<pair<string, string>> plots;
+    for (const auto & i : massList)
+        for (const auto & j : samples)
+            plots.emplace_back(i, j.first);
+
+    // Incremental mode: skip the plots whose inputs have the same hash as in the previous run and
+    // whose image is still there. The new hash of a plot is recorded only once it has been written, so
+    // a plot that couldn't be drawn is tried again by the next run
+    unique_ptr<plotCache> cache;
+    map<string, string> hashes;
+    if (incremental) {
+        histProvider &provider = histProvider::session(datafile);
+        if (!provider.isOpen())
+            return false;
+        provider.setViews(samples);
+
+        cache = make_unique<plotCache>(outputFolder + ".plotcache");
+        const vector<stackComponent> components = stacked ? stackComponents(cfg) : vector<stackComponent>();
+        vector<pair<string, string>> stalePlots;
+        for (const auto & plot : plots) {
+            string name = plot.first + "/" + plot.second + "_" + plot.first;
+            string hash = plotHash(provider, dataset, components, plot.first, plot.second, samples[plot.second]);
+            string file = outputFormat == plotFormat::pdf ? outputFolder + plot.first + ".pdf"
+                                                          : outputFolder + name + "." + plotExtension(outputFormat);
+            bool missing = gSystem->AccessPathName(file.c_str());
+            hashes[name] = hash;
+            if (!missing && cache->upToDate(name, hash))
                 continue;
+            stalePlots.push_back(plot);
+        }
+
+        // A pdf holds every plot of its mass region, so a single stale plot redraws the whole region
+        if (outputFormat == plotFormat::pdf) {
+            set<string> staleRegions;
+            for (const auto & plot : stalePlots)
+                staleRegions.insert(plot.first);
+            stalePlots.clear();
+            for (const auto & plot : plots)
+                if (staleRegions.count(plot.first))
+                    stalePlots.push_back(plot);
+        }
+        cout << "Graph: " << stalePlots.size() << " of " << plots.size() << " plots need to be drawn" << endl;
+        plots = stalePlots;
+    }
+    if (plots.empty())
+        return true;
+    auto recordWritten = [&](const vector<int>& written) {
+        if (!cache) return;
+        for (int k : written) {
+            const string name = plots[k].first + "/" + plots[k].second + "_" + plots[k].first;
+            cache->update(name, hashes[name]);
+        }
+        cache->save();
+    };
+
+    // Stacked mode: the plots are read from the pre-weighted stack cache, which is rebuilt here, before
+    // any worker starts, if the weights or the data file changed. Components with an unused dataset
+    // are left out
+    unique_ptr<stackCache> stacks;
+    set<string> unused;
+    if (stacked) {
+        stacks = make_unique<stackCache>(datafile, cfg);
+        if (!stacks->isOpen())
+            return false;
+        for (const auto & component : stacks->stack())
+            for (const auto & data : dataset)
+                if (data.isUsed == 0 && count(component.datasets.begin(), component.datasets.end(), data.name))
+                    unused.insert(component.name);
+    }
+
+    // Serial mode: a single canvas for every plot, and the histograms of the session's data file
+    if (nWorkers <= 1) {
+        histProvider &provider = histProvider::session(datafile);
+        if (!stacked && !provider.isOpen())
+            return false;
+        provider.setViews(samples);
+
+        // Create canvas with ticks
+        auto *c = new TCanvas("canvas", "canvas", 1800, 1000);
+        c->SetTicks();
+        plotOutput output(outputFolder, outputFormat);
+
+        // Loop through all simulated mass regions and samples
+        vector<int> saved;
+        for (size_t k = 0; k < plots.size(); ++k) {
+            const auto &plot = plots[k];
+            const bool drawn = stacked ? drawPlot(c, *stacks, unused, output, plot.first, plot.second, samples[plot.second])
+                                       : drawPlot(c, provider, dataset, output, plot.first, plot.second, samples[plot.second]);
+            if (drawn) saved.push_back(k);
+        }
+        const bool written = output.finish();
+        if (written) recordWritten(saved);
+        return written;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Parallel mode: worker w draws the plots w, w + nWorkers, w + 2*nWorkers, ... For pdf the pages of
+    // a mass region go to a single file, so worker w draws the mass regions w, w + nWorkers, ... instead.
+    // Every worker returns the indices of the plots it saved, or a single -1 if its output failed
+    gROOT->SetBatch(true);
+    vector<size_t> slot(plots.size());
+    for (size_t k = 0; k < plots.size(); ++k)
+        slot[k] = outputFormat == plotFormat::pdf ? find(massList.begin(), massList.end(), plots[k].first) - massList.begin() : k;
+    auto renderWorker = [&](unsigned worker) {
 
-            // If there is, check if either the expeimental or the generated data is empty and print only one histogram
-            else if (histStack->GetMaximum() == histStack->GetMinimum()) {
-                //expData->SetStats(0);
-                expData->Draw("");
-            } else if (expData->Integral() == 0)
-                histStack->Draw("HIST");
-
-            // If both histograms have data, then draw both
-            else {
-                if (histStack->GetMaximum() < expData->GetMaximum() + expData->GetBinError(expData->GetMaximumBin()) * 1.3)
-                    histStack->SetMaximum(expData->GetMaximum() + expData->GetBinError(expData->GetMaximumBin()) * 1.3);
-                histStack->Draw("HIST");
-                expData  ->Draw("e1x0p SAME");
-            }
-
-            // Draw the legend and plot the graph
-            legend->Draw("SAME");
-            c->SaveAs(location.append(j.first + "_" + i + ".png").c_str());
+        // Each worker opens its own file handles, since they can't be shared between processes
+        perfReport::global().startWorker();
+        unique_ptr<histProvider> provider;
+        unique_ptr<stackCache> workerStacks;
+        if (stacked) workerStacks = make_unique<stackCache>(datafile, cfg);
+        else         provider = make_unique<histProvider>(datafile);
+        if (stacked ? !workerStacks->isOpen() : !provider->isOpen())
+            return vector<int>{-1};
+        if (provider) provider->setViews(samples);
+
+        auto *c = new TCanvas("canvas", "canvas", 1800, 1000);
+        c->SetTicks();
+        plotOutput output(outputFolder, outputFormat);
+
+        vector<int> saved;
+        for (size_t k = 0; k < plots.size(); ++k) {
+            if (slot[k] % nWorkers != worker) continue;
+            const auto &plot = plots[k];
+            const bool drawn = stacked ? drawPlot(c, *workerStacks, unused, output, plot.first, plot.second, samples[plot.second])
+                                       : drawPlot(c, *provider, dataset, output, plot.first, plot.second, samples[plot.second]);
+            if (drawn) saved.push_back(k);
         }
+        const bool written = output.finish();
+        delete c;
+        perfReport::global().saveFragment(worker);
+        return written ? saved : vector<int>{-1};
+    };
+
+    ROOT::TProcessExecutor pool(nWorkers);
+    const vector<vector<int>> saved = pool.Map(renderWorker, ROOT::TSeqU(nWorkers));
+    perfReport::global().mergeFragments(nWorkers);
+    bool written = true;
+    vector<int> all;
+    for (const auto & indices : saved) {
+        if (indices.size() == 1 && indices[0] == -1) written = false;
+        else all.insert(all.end(), indices.begin(), indices.end());
     }
+    recordWritten(all);
+    return written;
 }
\ No newline at end of file
@@ -1,12 +1,21 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
 #include "TF1.h"
 #include "TH1.h"
+#include "TH2D.h"
 #include "TFile.h"
 #include "THStack.h"
 #include "TCanvas.h"
 #include "TLegend.h"
-#include "TTreeReaderArray.h"
 
-#include "datatypes.h"
+#include "config.h"
+#include "histProvider.h"
+#include "normalization.h"
+#include "perfReport.h"
+#include "plotEnvelope.h"
+#include "plotScope.h"
+#include "stackCache.h"
 
 using namespace std;
 
@@ -16,7 +25,6 @@ using namespace std;
 
 // Sample
 string sampleName = "AcoplZoom";
-const sampleStruct selSample = samples[sampleName];
 
 // Mass Region
 const string mass  = "RESOM";
@@ -26,94 +34,107 @@ const int nBin = 1;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-// DATASETS
-const dataStruct dataset[12] = {
-        {0, "dymumu"  ,WEIGHT_DYmumu  ,2  ,"PYTHIS Low-mass Drell-Yan #mu^{+}#mu^{-}"},
-        {0, "dymumuL" ,WEIGHT_DYmumuL ,2  ,"PYTHIA mid-mass Drell-Yan #mu^{+}#mu^{-}"},
-        {0, "dymumuH" ,WEIGHT_DYmumuH ,2  ,"PYTHIA high-mass Drell-Yan #mu^{+}#mu^{-}"},
-        {0, "inelinel",WEIGHT_inelinel,419,"LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (double dissociation)"},
-        {0, "inelel"  ,WEIGHT_inelel  ,30 ,"LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (single dissociation)"},
-        {0, "elel"    ,WEIGHT_elel    ,800,"LPAIR #gamma#gamma #rightarrow #mu^{+}#mu^{-} (elastic)"},
-        {0, "inclY1S" ,WEIGHT_inclY1S ,5  ,"PYTHIA/EvtGen Z2 #Upsilon(nS) #rightarrow #mu^{+}#mu^{-}"},
-        {0, "inclY2S" ,WEIGHT_inclY2S ,5 },
-        {0, "inclY3S" ,WEIGHT_inclY3S ,5 },
-        {1, "signal1" ,WEIGHT_signal1 ,40 ,"STARLIGHT #gamma p #rightarrow#Upsilon(nS) p #rightarrow #mu^{+}#mu^{-} (elast)"},
-        {1, "signal2" ,WEIGHT_signal2 ,40},
-        {1, "signal3" ,WEIGHT_signal3 ,40}};
+bool Norm(const char* datafile = "dataFile.root",
+          const char* configFile = "analysis.cfg") {
+    perfRun run("Norm");
+    perfContext context(sampleName, mass);
 
-///////////////////////////////////////////////////////////////////////////////////////////////
+    // Read the datasets and the selected sample from the configuration
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> dataset = cfg.datasetsFor("Norm");
+    if (!cfg.samples.count(sampleName)) {
+        Error("Norm", "Sample %s is not in %s", sampleName.c_str(), configFile);
+        return false;
+    }
+    const sampleStruct selSample = cfg.samples[sampleName];
 
-void Norm(const char* datafile = "dataFile.root") {
+    // Add the mass information, using fewer variables. The global sample name is left untouched so
+    // Norm() can be run again in the same session
+    const string histName = sampleName + "_" + mass;
 
-    // Add the mass information, using fewer variables
-    sampleName += "_" + mass;
+    // Histograms of the session's data file, shared with the other entry points
+    histProvider &provider = histProvider::session(datafile);
+    if (!provider.isOpen())
+        return false;
+    provider.setViews(cfg.samples);
 
     // Config canvas for plots
     auto *c = new TCanvas("canvas", "canvas", 1200, 1000);
     c->SetTicks();
 
+    // Every object created for the plot is owned by the scope
+    plotScope scope(c);
+
     // Create a THStack with adequate units in the x-axis
     THStack *histStack;
     if (selSample.unit.empty())
-        histStack = new THStack(selSample.title.c_str(),
-                                string(sampleName + ";" + selSample.description).c_str());
+        histStack = scope.make<THStack>(selSample.title.c_str(),
+                                        string(histName + ";" + selSample.description).c_str());
     else
-        histStack = new THStack(selSample.title.c_str(),
-                                string(sampleName + ";" + selSample.description + " (" + selSample.unit + ")").c_str());
+        histStack = scope.make<THStack>(selSample.title.c_str(),
+                                        string(histName + ";" + selSample.description + " (" + selSample.unit + ")").c_str());
 
     // Config legend and it's position
-    auto legend = new TLegend(0.45,.68,.88,0.87);
+    auto legend = scope.make<TLegend>(0.45,.68,.88,0.87);
     legend->SetBorderSize(0);
     legend->SetFillColorAlpha(kWhite, 0);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
     // Read experimental data
-    unique_ptr<TFile> dataCluster(TFile::Open(datafile));
-    string file = sampleName + "_" + "data";
-    auto *expData(dataCluster->Get<TH1>(file.c_str()));
+    auto *expData(scope.adopt(provider.copy(sampleName, mass, "data")));
+    if (!expData) {
+        Error("Norm", "Histogram %s_data not found in %s", histName.c_str(), datafile);
+        return false;
+    }
     expData->SetMarkerStyle(20);
     expData->SetLineColor(kBlack);
     legend->AddEntry(expData, "Data", "lp");
 
-    // Read simulated data and config variables used in the normalization
-    double dataValue = expData->GetBinContent(nBin), sum = 0, fit = 0;
+    // Read every simulated dataset, already scaled by its weight, exactly once. The weighted histograms
+    // are kept for the stack, the sums give the normalization factor
+    normBuffers buffers;
+    buffers.reset(expData->GetNcells());
+    binContents(expData, buffers.data);
+
+    vector<double> contents;
+    vector<pair<const dataStruct*, TH1*>> templates;
     for (const dataStruct& data: dataset){
-        file = sampleName + "_" + data.name;
-        TH1* h(dataCluster->Get<TH1>(file.c_str()));
+        TH1* h(scope.adopt(provider.copy(sampleName, mass, data.name, data.weight)));
 
-        // If the histogram is empty, skip it
-        if (h->Integral() == 0)
+        // If the histogram is missing or empty, skip it
+        if (!h || h->Integral() == 0)
             continue;
 
         // Get the sum of all histograms and the one to be normalized
-        h->Scale(data.weight);
-        if(data.isUsed == 1) fit += h->GetBinContent(nBin);
-        sum += h->GetBinContent(1);
+        binContents(h, contents);
+        addTemplate(buffers, contents, 1., data.isUsed == 1);
+        templates.emplace_back(&data, h);
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
     // Print the normalization value
-    std::cout << (fit + dataValue - sum) / fit << std::endl;
+    const double factor = buffers.factor(nBin);
+    std::cout << factor << std::endl;
 
-    // Draw the histograms
-    for (const dataStruct& data: dataset){
-        file = sampleName + "_" + data.name;
-        TH1* h(dataCluster->Get<TH1>(file.c_str()));
-
-        // If the histogram is empty, skip it
-        if (h->Integral() == 0) {
-            continue;
-        }
+    // Draw the histograms, accumulating the stacked sum and the ranges while the stack is composed
+    perfTimer drawTimer("draw");
+    plotEnvelope envelope;
+    envelope.setData(*expData);
+    for (const auto & entry : templates){
+        const dataStruct& data = *entry.first;
+        TH1* h = entry.second;
 
         // Personalize the histogram
         h->SetLineColor(kBlack);
         h->SetFillColor(data.color);
 
-        // Fit the histogram and return the calculated value
+        // Apply the normalization to the fitted datasets
         if (data.isUsed == 1){
-            h->Scale((fit + dataValue - sum) / fit);
+            h->Scale(factor);
         }
 
         // Add a legend to the histogram (if it's needed)
@@ -122,18 +143,169 @@ void Norm(const char* datafile = "dataFile.root") {
         }
 
         // Add the histogram to the stack
+        envelope.addLayer(*h);
         histStack->Add(h);
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
     // If both histograms have data, then draw both
-    if (histStack->GetMaximum() < expData->GetMaximum() + expData->GetBinError(expData->GetMaximumBin()) * 1.3)
-        histStack->SetMaximum(expData->GetMaximum() + expData->GetBinError(expData->GetMaximumBin()) * 1.3);
+    if (envelope.stackMaximum() < envelope.dataTop())
+        histStack->SetMaximum(envelope.dataTop());
     histStack->Draw("HIST");
     expData->Draw(" SAME");
 
     // Draw the legend and plot the graph
     legend->Draw("SAME");
-    c->SaveAs(string(sampleName + "_NORM" + (fit + dataValue - sum) / fit + ".png").c_str());
+    drawTimer.stop();
+    perfTimer saveTimer("save");
+    c->SaveAs(string(histName + "_NORM" + to_string(factor) + ".png").c_str());
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// NormAll() from the stack cache: the normalized sum is the sum of the components whose datasets are
+// all normalized. A component mixing normalized and fixed datasets can't be split, so it is an error
+bool normAllStacked(const char* datafile, const char* outputFile, const analysisConfig& cfg,
+                    const vector<dataStruct>& dataset) {
+    stackCache stacks(datafile, cfg);
+    if (!stacks.isOpen())
+        return false;
+
+    vector<bool> used;
+    for (const auto & component : stacks.stack()) {
+        int nUsed = 0;
+        for (const auto & data : dataset)
+            if (data.isUsed == 1 && count(component.datasets.begin(), component.datasets.end(), data.name))
+                ++nUsed;
+        if (nUsed != 0 && nUsed != int(component.datasets.size())) {
+            Error("NormAll", "Group %s has both normalized and fixed datasets", component.name.c_str());
+            return false;
+        }
+        used.push_back(nUsed != 0);
+    }
+
+    ofstream out(outputFile);
+    if (!out) {
+        Error("NormAll", "Cannot create %s", outputFile);
+        return false;
+    }
+    out << "sample\tmass\tbin\tfactor\n";
+
+    normBuffers buffers;
+    int nFactors = 0;
+    for (const auto & j : cfg.samples) {
+        for (const auto & mass : cfg.massList) {
+            perfContext context(j.first, mass);
+            unique_ptr<TH2D> packed(stacks.get(j.first, mass));
+            if (!packed) continue;
+
+            // Row 0 is the data, row k + 1 the weighted component k
+            perfTimer timer("normalize");
+            const int nBins = packed->GetNbinsX();
+            buffers.reset(nBins + 2);
+            for (int bin = 0; bin <= nBins + 1; ++bin) {
+                buffers.data[bin] = packed->GetBinContent(bin, 1);
+                for (size_t k = 0; k < used.size(); ++k) {
+                    const double content = packed->GetBinContent(bin, k + 2);
+                    buffers.sum[bin] += content;
+                    if (used[k]) buffers.fit[bin] += content;
+                }
+            }
+
+            // Bins without any normalized dataset have no factor
+            for (int bin = 1; bin <= nBins; ++bin) {
+                if (buffers.fit[bin] == 0) continue;
+                out << j.first << "\t" << mass << "\t" << bin << "\t" << buffers.factor(bin) << "\n";
+                ++nFactors;
+            }
+        }
+    }
+
+    out.close();
+    if (!out) {
+        Error("NormAll", "Cannot write %s", outputFile);
+        return false;
+    }
+    std::cout << "NormAll: " << nFactors << " normalization factors written to " << outputFile << std::endl;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Batch mode: normalization factor of every (sample, mass region, bin) computed in one pass over the
+// data file, which is opened only once, and written as a tab separated table. In stacked mode each
+// (sample, mass region) is a single read of the pre-weighted stack cache instead
+bool NormAll(const char* datafile = "dataFile.root",
+             const char* outputFile = "normFactors.tsv",
+             const char* configFile = "analysis.cfg",
+             bool stacked = false) {
+    perfRun run("NormAll");
+
+    // Read the datasets, samples and mass regions
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> dataset = cfg.datasetsFor("Norm");
+    if (stacked) {
+        return normAllStacked(datafile, outputFile, cfg, dataset);
+    }
+
+    // Open the data file once and index all of its histograms. Views are computed from their master
+    histProvider provider(datafile);
+    if (!provider.isOpen())
+        return false;
+    provider.setViews(cfg.samples);
+
+    ofstream out(outputFile);
+    if (!out) {
+        Error("NormAll", "Cannot create %s", outputFile);
+        return false;
+    }
+    out << "sample\tmass\tbin\tfactor\n";
+
+    normBuffers buffers;
+    vector<double> contents;
+    int nFactors = 0;
+    for (const auto & j : cfg.samples) {
+        for (const auto & mass : cfg.massList) {
+            perfContext context(j.first, mass);
+
+            // Read experimental data
+            auto expData = provider.get(j.first, mass, "data");
+            if (!expData) continue;
+            buffers.reset(expData->GetNcells());
+            binContents(expData.get(), buffers.data);
+
+            // Weighted sums of the simulated data over all bins at once
+            for (const dataStruct& data : dataset) {
+                auto h = provider.get(j.first, mass, data.name);
+                if (!h) continue;
+                if (h->GetNcells() != expData->GetNcells()) {
+                    Warning("NormAll", "%s_%s_%s has a different binning than the data, skipping it",
+                            j.first.c_str(), mass.c_str(), data.name.c_str());
+                    continue;
+                }
+                perfTimer timer("normalize");
+                binContents(h.get(), contents);
+                addTemplate(buffers, contents, data.weight, data.isUsed == 1);
+            }
+
+            // Bins without any normalized dataset have no factor
+            for (int bin = 1; bin <= expData->GetNbinsX(); ++bin) {
+                if (buffers.fit[bin] == 0) continue;
+                out << j.first << "\t" << mass << "\t" << bin << "\t" << buffers.factor(bin) << "\n";
+                ++nFactors;
+            }
+        }
+    }
+
+    out.close();
+    if (!out) {
+        Error("NormAll", "Cannot write %s", outputFile);
+        return false;
+    }
+    std::cout << "NormAll: " << nFactors << " normalization factors written to " << outputFile << std::endl;
+    return true;
 }
\ No newline at end of file
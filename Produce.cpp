@@ -0,0 +1,169 @@
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <TFile.h>
+#include <TH1.h>
+#include <TROOT.h>
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RDFHelpers.hxx"
+
+#include "config.h"
+#include "histCatalog.h"
+#include "histMap.h"
+#include "histProvider.h"
+#include "perfReport.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Produce the data file read by Graph(), Norm() and Fit() directly from the ntuples: every booked
+// sample is filled in every mass region with a selection, for the experimental data and for every
+// dataset with an ntuple. All the histograms are booked lazily first, so the event loop of each ntuple
+// runs only once, and the loops of all the ntuples run together on nThreads threads (0 for all the
+// cores). The histograms are unweighted and stored as "<sample>_<mass>_<dataset>". Views are not stored,
+// they are computed from their master sample when read
+bool Produce(const char* outputFile = "dataFile.root",
+             unsigned nThreads = 0,
+             const char* configFile = "analysis.cfg") {
+    perfRun run("Produce");
+
+    // Read the ntuples, selections and bookings from the configuration
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    if (cfg.ntuples.empty() || cfg.bookings.empty()) {
+        Error("Produce", "No ntuple or no booked sample in %s", configFile);
+        return false;
+    }
+    for (const auto & mass : cfg.massList)
+        if (!cfg.regions.count(mass))
+            Warning("Produce", "Mass region %s has no selection, skipped", mass.c_str());
+    for (const auto & sample : cfg.samples)
+        if (!cfg.bookings.count(sample.first) && !sample.second.derived())
+            Warning("Produce", "Sample %s is not booked, skipped", sample.first.c_str());
+
+    ROOT::EnableImplicitMT(nThreads);
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Book every (sample, mass region) histogram of every ntuple. Each sample expression is defined
+    // once per ntuple as a column, shared by all the mass regions
+    vector<ROOT::RDataFrame> frames;
+    frames.reserve(cfg.ntuples.size());
+    map<string, ROOT::RDF::RResultPtr<TH1D>> histograms;
+    vector<ROOT::RDF::RResultHandle> handles;
+    for (const auto & source : cfg.ntuples) {
+        frames.emplace_back(source.tree, source.files);
+        ROOT::RDF::RNode node = frames.back();
+
+        map<string, string> columns;
+        for (const auto & booking : cfg.bookings) {
+            columns[booking.first] = "produce_" + booking.first;
+            node = node.Define(columns[booking.first], booking.second.expression);
+        }
+
+        for (const auto & mass : cfg.massList) {
+            auto region = cfg.regions.find(mass);
+            if (region == cfg.regions.end())
+                continue;
+            ROOT::RDF::RNode selected = node.Filter(region->second, mass);
+
+            for (const auto & booking : cfg.bookings) {
+                const string key = booking.first + "_" + mass + "_" + source.dataset;
+                const bookingStruct &b = booking.second;
+                ROOT::RDF::TH1DModel model(key.c_str(), cfg.samples[booking.first].title.c_str(), b.nBins, b.lo, b.hi);
+                auto h = b.selection.empty() ? selected.Histo1D(model, columns[booking.first])
+                                             : selected.Filter(b.selection).Histo1D(model, columns[booking.first]);
+                histograms[key] = h;
+                handles.emplace_back(h);
+            }
+        }
+    }
+
+    // Run the event loops of all the ntuples concurrently
+    {
+        perfTimer timer("event loop");
+        ROOT::RDF::RunGraphs(handles);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Write the histograms, dropping first any cached view of an older version of the file
+    histProvider::closeSession(outputFile);
+    perfTimer writeTimer("write");
+    TFile out(outputFile, "RECREATE");
+    if (out.IsZombie()) {
+        Error("Produce", "Cannot create %s", outputFile);
+        return false;
+    }
+    bool written = true;
+    for (auto & entry : histograms) {
+        TH1D *h = entry.second.GetPtr();
+        h->SetDirectory(nullptr);
+        written &= out.WriteObject(h, entry.first.c_str()) > 0;
+    }
+    out.Close();
+    if (!written) {
+        Error("Produce", "Cannot write %s", outputFile);
+        return false;
+    }
+
+    cout << "Produce: " << histograms.size() << " histograms from " << cfg.ntuples.size()
+         << " ntuples written to " << outputFile << endl;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Export every 1D histogram of a data file to a memory-mappable ".hmap" file (see histMap.h), which
+// Graph(), Norm() and Fit() accept as datafile and external tools can read without ROOT. The data
+// file may be a list of files (see histCatalog.h), merged into one export. An empty outputFile gives
+// the data file name with ".root" replaced by ".hmap", or dataFile.hmap for several files
+bool Export(const char* datafile = "dataFile.root",
+            const char* outputFile = "") {
+    perfRun run("Export");
+
+    string output = outputFile;
+    vector<string> inputs;
+    if (!histCatalog::inputFiles(datafile, inputs))
+        return false;
+    if (output.empty() && inputs.size() != 1)
+        output = "dataFile.hmap";
+    else if (output.empty()) {
+        output = inputs[0];
+        const string suffix = ".root";
+        if (output.size() > suffix.size() && output.compare(output.size() - suffix.size(), suffix.size(), suffix) == 0)
+            output.resize(output.size() - suffix.size());
+        output += ".hmap";
+    }
+
+    histCatalog dataCluster(datafile);
+    if (!dataCluster.isOpen())
+        return false;
+    histProvider::closeSession(output);
+    histMapWriter writer(output.c_str());
+    if (!writer.isOpen())
+        return false;
+
+    int nExported = 0;
+    for (const auto & name : dataCluster.names()) {
+        unique_ptr<TH1> h(dataCluster.get(name));
+        if (!h) continue;
+        if (h->GetDimension() != 1) {
+            Warning("Export", "%s is not a 1D histogram, skipped", name.c_str());
+            continue;
+        }
+        writer.add(name, *h);
+        ++nExported;
+    }
+    if (!writer.close()) {
+        Error("Export", "Cannot write %s", output.c_str());
+        return false;
+    }
+
+    cout << "Export: " << nExported << " histograms written to " << output << endl;
+    return true;
+}
@@ -0,0 +1,207 @@
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <TFile.h>
+#include <TH1.h>
+#include <TH1F.h>
+
+#include "config.h"
+#include "histProvider.h"
+#include "normalization.h"
+#include "perfReport.h"
+#include "stackCache.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Weight variations of a whole analysis in one pass over the data file. Every unweighted histogram
+// is read once, and since a weight is a product of the luminosity, the cross section and the other
+// factors, the histograms of every variation are linear combinations of the same templates, computed
+// in memory. For every (sample, mass region) with data this writes, with one column per variation
+// ("nominal" first, then the "variation" and "systematic" lines of the configuration):
+//  - outputFile: the yield of every stack component (see stackCache.h), of their total and of the data
+//  - normFile: the NormAll() factor of every bin, with the datasets used by Norm
+//  - fitFile: for the PtPair samples, the data and the exclusive and dissociative histograms of Fit()
+//    for every variation, as "<sample>_<mass>_data" and "<sample>_<mass>_<variation>_exc|dis"
+bool Systematics(const char* datafile = "dataFile.root",
+                 const char* outputFile = "systYields.tsv",
+                 const char* normFile = "systFactors.tsv",
+                 const char* fitFile = "systFitInputs.root",
+                 const char* configFile = "analysis.cfg") {
+    perfRun run("Systematics");
+
+    // Read the datasets, samples, mass regions and weight variations
+    analysisConfig cfg;
+    if (!loadConfig(configFile, cfg))
+        return false;
+    const vector<dataStruct> normSet = cfg.datasetsFor("Norm");
+    const vector<dataStruct> fitSet  = cfg.datasetsFor("Fit");
+    vector<weightVariation> variations = {{"nominal", {}}};
+    variations.insert(variations.end(), cfg.variations.begin(), cfg.variations.end());
+
+    // Weight of every dataset in every variation
+    const size_t nData = cfg.datasets.size();
+    vector<vector<double>> weights(variations.size(), vector<double>(nData));
+    for (size_t v = 0; v < variations.size(); ++v) {
+        auto scales = variations[v].datasetScales(cfg.datasets);
+        for (size_t d = 0; d < nData; ++d)
+            weights[v][d] = cfg.datasets[d].weight * scales[cfg.datasets[d].name];
+    }
+
+    // Stack component of every dataset
+    const vector<stackComponent> components = stackComponents(cfg);
+    vector<size_t> componentOf(nData);
+    for (size_t k = 0; k < components.size(); ++k)
+        for (const auto & name : components[k].datasets)
+            for (size_t d = 0; d < nData; ++d)
+                if (cfg.datasets[d].name == name) componentOf[d] = k;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    histProvider provider(datafile);
+    if (!provider.isOpen())
+        return false;
+    provider.setViews(cfg.samples);
+    unique_ptr<TFile> fitOut(TFile::Open(fitFile, "RECREATE"));
+    if (!fitOut || fitOut->IsZombie()) {
+        Error("Systematics", "Cannot create %s", fitFile);
+        return false;
+    }
+
+    ofstream yields(outputFile), factors(normFile);
+    if (!yields || !factors) {
+        Error("Systematics", "Cannot create %s", !yields ? outputFile : normFile);
+        return false;
+    }
+    yields  << "sample\tmass\tcomponent";
+    factors << "sample\tmass\tbin";
+    for (const auto & variation : variations) {
+        yields  << "\t" << variation.name;
+        factors << "\t" << variation.name;
+    }
+    yields << "\n";
+    factors << "\n";
+
+    // Unweighted contents and squared errors of every dataset, indexed like the histogram cells
+    vector<vector<double>> contents(nData), errors2(nData);
+    vector<double> integrals(nData), dataContents;
+    vector<bool> present(nData);
+    vector<normBuffers> buffers(variations.size());
+    int nPlots = 0;
+    for (const auto & j : cfg.samples) {
+        const bool fitted = j.first.rfind("PtPair", 0) == 0;
+        for (const auto & mass : cfg.massList) {
+            perfContext context(j.first, mass);
+
+            auto expData = provider.get(j.first, mass, "data");
+            if (!expData) continue;
+            const int nBins = expData->GetNbinsX();
+            binContents(expData.get(), dataContents);
+
+            for (size_t d = 0; d < nData; ++d) {
+                auto h = provider.get(j.first, mass, cfg.datasets[d].name);
+                present[d] = h && h->GetNcells() == expData->GetNcells();
+                if (!present[d]) {
+                    if (h) Warning("Systematics", "%s_%s_%s has a different binning than the data, skipping it",
+                                   j.first.c_str(), mass.c_str(), cfg.datasets[d].name.c_str());
+                    continue;
+                }
+                binContents(h.get(), contents[d]);
+                errors2[d].resize(h->GetNcells());
+                for (int cell = 0; cell < h->GetNcells(); ++cell)
+                    errors2[d][cell] = h->GetBinError(cell) * h->GetBinError(cell);
+                integrals[d] = h->Integral();
+            }
+
+            perfTimer timer("combine");
+
+            // Stacked yields
+            vector<vector<double>> componentYields(components.size(), vector<double>(variations.size(), 0.));
+            vector<double> totals(variations.size(), 0.);
+            for (size_t v = 0; v < variations.size(); ++v)
+                for (size_t d = 0; d < nData; ++d) {
+                    if (!present[d]) continue;
+                    componentYields[componentOf[d]][v] += weights[v][d] * integrals[d];
+                    totals[v] += weights[v][d] * integrals[d];
+                }
+            for (size_t k = 0; k < components.size(); ++k) {
+                yields << j.first << "\t" << mass << "\t" << components[k].name;
+                for (double yield : componentYields[k])
+                    yields << "\t" << yield;
+                yields << "\n";
+            }
+            yields << j.first << "\t" << mass << "\ttotal";
+            for (double total : totals)
+                yields << "\t" << total;
+            yields << "\n" << j.first << "\t" << mass << "\tdata";
+            for (size_t v = 0; v < variations.size(); ++v)
+                yields << "\t" << expData->Integral();
+            yields << "\n";
+
+            // Normalization factors. Bins without any normalized dataset have no row, and a variation that
+            // leaves no normalized yield in a bin (e.g. a Down scale of 0) has no factor there, written as nan
+            for (size_t v = 0; v < variations.size(); ++v) {
+                buffers[v].reset(expData->GetNcells());
+                buffers[v].data = dataContents;
+                for (size_t d = 0; d < nData; ++d)
+                    if (present[d])
+                        addTemplate(buffers[v], contents[d], weights[v][d], normSet[d].isUsed == 1);
+            }
+            for (int bin = 1; bin <= nBins; ++bin) {
+                bool normalized = false;
+                for (const auto & buffer : buffers)
+                    normalized |= buffer.fit[bin] != 0;
+                if (!normalized) continue;
+                factors << j.first << "\t" << mass << "\t" << bin;
+                for (const auto & buffer : buffers) {
+                    if (buffer.fit[bin] != 0) factors << "\t" << buffer.factor(bin);
+                    else                      factors << "\tnan";
+                }
+                factors << "\n";
+            }
+
+            // Fit inputs, binned like readFitInputs() does
+            if (fitted) {
+                const string prefix = j.first + "_" + mass + "_";
+                const Double_t upperLimit = expData->GetBinCenter(nBins) + expData->GetBinWidth(nBins) / 2;
+                fitOut->WriteObject(expData.get(), (prefix + "data").c_str());
+                for (size_t v = 0; v < variations.size(); ++v) {
+                    TH1F exc((prefix + variations[v].name + "_exc").c_str(), "Exclusive", nBins, 0, upperLimit);
+                    TH1F dis((prefix + variations[v].name + "_dis").c_str(), "Dissociative", nBins, 0, upperLimit);
+                    exc.SetDirectory(nullptr);
+                    dis.SetDirectory(nullptr);
+                    exc.Sumw2();
+                    dis.Sumw2();
+                    for (size_t d = 0; d < nData; ++d) {
+                        if (!present[d]) continue;
+                        TH1F &h = fitSet[d].isUsed == 1 ? exc : dis;
+                        const double w = weights[v][d];
+                        for (int cell = 0; cell <= nBins + 1; ++cell) {
+                            h.GetArray()[cell]             += w * contents[d][cell];
+                            h.GetSumw2()->GetArray()[cell] += w * w * errors2[d][cell];
+                        }
+                    }
+                    exc.SetEntries(exc.Integral());
+                    dis.SetEntries(dis.Integral());
+                    fitOut->WriteObject(&exc, exc.GetName());
+                    fitOut->WriteObject(&dis, dis.GetName());
+                }
+            }
+            ++nPlots;
+        }
+    }
+    fitOut->Close();
+    yields.close();
+    factors.close();
+    if (!yields || !factors) {
+        Error("Systematics", "Cannot write %s", !yields ? outputFile : normFile);
+        return false;
+    }
+
+    cout << "Systematics: " << variations.size() << " variations of " << nPlots << " (sample, mass region) pairs written to "
+         << outputFile << ", " << normFile << " and " << fitFile << endl;
+    return true;
+}
@@ -0,0 +1,501 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "TError.h"
+
+#include "datatypes.h"
+
+// Named set of scale factors applied on top of the dataset weights: on the whole weight of a dataset
+// ("*" for every dataset), on the luminosity, or on the cross section of a dataset. The weight is a
+// product of these factors, so all of them combine as multiplications
+struct weightVariation {
+    std::string                   name;
+    std::map<std::string, double> scales;
+    double                        lumi = 1.;
+    std::map<std::string, double> crossSections;
+
+    // Scale of every dataset, with the "*", luminosity and cross section entries folded in
+    std::map<std::string, double> datasetScales(const std::vector<dataStruct>& datasets) const {
+        std::map<std::string, double> result;
+        auto all = scales.find("*");
+        for (const auto & data : datasets) {
+            auto it = scales.find(data.name);
+            auto xsec = crossSections.find(data.name);
+            result[data.name] = (all == scales.end() ? 1. : all->second) * (it == scales.end() ? 1. : it->second)
+                              * lumi * (xsec == crossSections.end() ? 1. : xsec->second);
+        }
+        return result;
+    }
+
+    // Apply a scale to a target: "lumi", "xsec:<dataset|group>", "<dataset>" or "*". A target scaled
+    // twice gets the product of both scales. Cross sections of groups are expanded to their datasets
+    // once the configuration is read, multiplying with those of their datasets
+    void scale(const std::string& target, double value) {
+        if (target == "lumi")
+            lumi *= value;
+        else if (target.compare(0, 5, "xsec:") == 0)
+            crossSections.emplace(target.substr(5), 1.).first->second *= value;
+        else
+            scales.emplace(target, 1.).first->second *= value;
+    }
+};
+
+// Datasets fitted together with a single normalization (see templateFit.h), and drawn as one block
+// with their own legend in the stacked plots (see stackCache.h)
+struct datasetGroup {
+    std::string              name;
+    std::vector<std::string> datasets;
+    std::string              legend;
+};
+
+// Ntuple the histograms of a dataset are produced from ("data" for the experimental data). The file
+// names may contain wildcards
+struct ntupleSource {
+    std::string              dataset;
+    std::string              tree;
+    std::vector<std::string> files;
+};
+
+// Expression, binning and optional extra selection a sample is filled with by Produce()
+struct bookingStruct {
+    std::string expression;
+    int         nBins = 0;
+    double      lo    = 0;
+    double      hi    = 0;
+    std::string selection;
+};
+
+// Dataset, sample and mass region tables shared by Graph(), Norm() and Fit(), read at startup from a
+// text configuration file (see analysis.cfg for the format)
+struct analysisConfig {
+    Double_t                                     lumi = 0;
+    std::vector<std::string>                     massList;
+    std::vector<dataStruct>                      datasets;
+    std::map<std::string, std::set<std::string>> used;
+    std::map<std::string, sampleStruct>          samples;
+    std::vector<weightVariation>                 variations;
+    std::vector<datasetGroup>                    groups;
+    std::vector<ntupleSource>                    ntuples;
+    std::map<std::string, std::string>           regions;
+    std::map<std::string, bookingStruct>         bookings;
+
+    // Datasets with isUsed set according to the "use" line of the entry point (all of them if it has none)
+    std::vector<dataStruct> datasetsFor(const std::string& entry) const {
+        std::vector<dataStruct> selected = datasets;
+        auto it = used.find(entry);
+        for (auto & data : selected)
+            data.isUsed = it == used.end() || it->second.count(data.name) ? 1 : 0;
+        return selected;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// A token of a configuration line, remembering if it was written between quotes
+struct configToken {
+    std::string text;
+    bool        quoted;
+};
+
+// Split a line in whitespace separated tokens, keeping quoted strings together and dropping comments
+inline std::vector<configToken> tokenizeConfigLine(const std::string& line) {
+    std::vector<configToken> tokens;
+    size_t pos = 0;
+    while (pos < line.size()) {
+        if (isspace((unsigned char) line[pos])) { ++pos; continue; }
+        if (line[pos] == '#') break;
+        if (line[pos] == '"') {
+            size_t end = line.find('"', pos + 1);
+            if (end == std::string::npos) end = line.size();
+            tokens.push_back({line.substr(pos + 1, end - pos - 1), true});
+            pos = end + 1;
+        } else {
+            size_t end = pos;
+            while (end < line.size() && !isspace((unsigned char) line[end])) ++end;
+            tokens.push_back({line.substr(pos, end - pos), false});
+            pos = end;
+        }
+    }
+    return tokens;
+}
+
+// Parse a number, returning false if the token is not entirely a number
+inline bool parseConfigNumber(const configToken& token, double& value) {
+    if (token.quoted || token.text.empty()) return false;
+    char *end = nullptr;
+    value = strtod(token.text.c_str(), &end);
+    return *end == '\0';
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Read and validate a configuration file. Every problem found is reported, and false is returned if
+// there was any, so a job with a bad configuration stops before reading any data
+inline bool loadConfig(const std::string& path, analysisConfig& cfg) {
+    std::ifstream in(path);
+    if (!in) {
+        Error("loadConfig", "Cannot open configuration file %s", path.c_str());
+        return false;
+    }
+
+    // Dataset lines are kept to compute the weights once the luminosity is known
+    struct datasetLine { int line; double nGenerated, crossSection; std::vector<double> factors; };
+    std::vector<datasetLine> datasetLines;
+
+    // View lines are attached to their samples once every sample is known
+    struct viewLine { int line; std::string sample; sampleView view; };
+    std::vector<viewLine> viewLines;
+
+    int nErrors = 0, lineNumber = 0;
+    auto fail = [&](const std::string& message) {
+        Error("loadConfig", "%s:%d: %s", path.c_str(), lineNumber, message.c_str());
+        ++nErrors;
+    };
+
+    std::string line;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        auto tokens = tokenizeConfigLine(line);
+        if (tokens.empty()) continue;
+        const std::string& directive = tokens[0].text;
+
+        // lumi <integrated luminosity>
+        if (directive == "lumi") {
+            if (tokens.size() != 2 || !parseConfigNumber(tokens[1], cfg.lumi) || !(cfg.lumi > 0))
+                fail("expected \"lumi <positive value>\"");
+        }
+
+        // mass <region>...
+        else if (directive == "mass") {
+            for (size_t k = 1; k < tokens.size(); ++k) {
+                for (const auto & mass : cfg.massList)
+                    if (mass == tokens[k].text) fail("mass region " + mass + " defined twice");
+                cfg.massList.push_back(tokens[k].text);
+            }
+        }
+
+        // dataset <name> <color> <generated events> <cross section> [factors...] ["legend"]
+        else if (directive == "dataset") {
+            double color;
+            datasetLine entry{lineNumber, 0, 0, {}};
+            if (tokens.size() < 5 || !parseConfigNumber(tokens[2], color) ||
+                !parseConfigNumber(tokens[3], entry.nGenerated) || !parseConfigNumber(tokens[4], entry.crossSection)) {
+                fail("expected \"dataset <name> <color> <generated events> <cross section> [factors...] [\\\"legend\\\"]\"");
+                continue;
+            }
+
+            dataStruct data{1, tokens[1].text, 0, Color_t(color), ""};
+            for (size_t k = 5; k < tokens.size(); ++k) {
+                double factor;
+                if (k == tokens.size() - 1 && tokens[k].quoted)
+                    data.legend = tokens[k].text;
+                else if (parseConfigNumber(tokens[k], factor))
+                    entry.factors.push_back(factor);
+                else
+                    fail("invalid factor \"" + tokens[k].text + "\" for dataset " + data.name);
+            }
+            if (!(entry.nGenerated > 0))
+                fail("dataset " + data.name + " needs a positive number of generated events");
+            for (const auto & other : cfg.datasets)
+                if (other.name == data.name) fail("dataset " + data.name + " defined twice");
+
+            cfg.datasets.push_back(data);
+            datasetLines.push_back(entry);
+        }
+
+        // use <entry point> <dataset>...
+        else if (directive == "use") {
+            if (tokens.size() < 2) {
+                fail("expected \"use <entry point> <dataset>...\"");
+                continue;
+            }
+            auto &selected = cfg.used[tokens[1].text];
+            for (size_t k = 2; k < tokens.size(); ++k)
+                selected.insert(tokens[k].text);
+        }
+
+        // sample <key> <title> "<description>" "<unit>" [log]
+        else if (directive == "sample") {
+            if (tokens.size() < 5 || tokens.size() > 6 || (tokens.size() == 6 && tokens[5].text != "log")) {
+                fail("expected \"sample <key> <title> \\\"<description>\\\" \\\"<unit>\\\" [log]\"");
+                continue;
+            }
+            if (cfg.samples.count(tokens[1].text))
+                fail("sample " + tokens[1].text + " defined twice");
+            cfg.samples[tokens[1].text] = {tokens[2].text, tokens[3].text, tokens[4].text, tokens.size() == 6};
+        }
+
+        // view <sample> <master> [zoom <low> <high>] [rebin <n>] [edges <edge>...] [perwidth]
+        else if (directive == "view") {
+            const std::string usage = "expected \"view <sample> <master> [zoom <low> <high>] [rebin <n>] "
+                                      "[edges <edge>...] [perwidth]\"";
+            if (tokens.size() < 3) {
+                fail(usage);
+                continue;
+            }
+            viewLine entry{lineNumber, tokens[1].text, {}};
+            entry.view.master = tokens[2].text;
+            bool valid = true;
+            for (size_t k = 3; k < tokens.size() && valid; ++k) {
+                const std::string& option = tokens[k].text;
+                double rebin;
+                if (option == "zoom") {
+                    valid = k + 2 < tokens.size() && parseConfigNumber(tokens[k + 1], entry.view.lo) &&
+                            parseConfigNumber(tokens[k + 2], entry.view.hi) && entry.view.hi > entry.view.lo;
+                    k += 2;
+                }
+                else if (option == "rebin") {
+                    valid = k + 1 < tokens.size() && parseConfigNumber(tokens[k + 1], rebin) && rebin >= 1 &&
+                            rebin == int(rebin);
+                    entry.view.rebin = valid ? int(rebin) : 1;
+                    ++k;
+                }
+                else if (option == "edges") {
+                    double edge;
+                    while (k + 1 < tokens.size() && parseConfigNumber(tokens[k + 1], edge)) {
+                        valid &= entry.view.edges.empty() || edge > entry.view.edges.back();
+                        entry.view.edges.push_back(edge);
+                        ++k;
+                    }
+                    valid &= entry.view.edges.size() >= 2;
+                }
+                else if (option == "perwidth")
+                    entry.view.perWidth = true;
+                else
+                    valid = false;
+            }
+            if (!valid)
+                fail(usage);
+            else if (entry.view.rebin > 1 && !entry.view.edges.empty())
+                fail("view " + entry.sample + " can't have both rebin and edges");
+            else
+                viewLines.push_back(entry);
+        }
+
+        // variation <name> <dataset|*> <scale> [<dataset|*> <scale>...]
+        else if (directive == "variation") {
+            if (tokens.size() < 4 || tokens.size() % 2 != 0) {
+                fail("expected \"variation <name> <dataset|*> <scale> [<dataset|*> <scale>...]\"");
+                continue;
+            }
+            weightVariation variation{tokens[1].text, {}};
+            for (size_t k = 2; k + 1 < tokens.size(); k += 2) {
+                double scale;
+                if (!parseConfigNumber(tokens[k + 1], scale) || !(scale >= 0))
+                    fail("invalid scale \"" + tokens[k + 1].text + "\" in variation " + variation.name);
+                variation.scale(tokens[k].text, scale);
+            }
+            for (const auto & other : cfg.variations)
+                if (other.name == variation.name) fail("variation " + variation.name + " defined twice");
+            if (variation.name == "nominal")
+                fail("the nominal variation is implicit and can't be redefined");
+            cfg.variations.push_back(variation);
+        }
+
+        // systematic <name> <target> <relative uncertainty>: the variations <name>Up and <name>Down
+        else if (directive == "systematic") {
+            double uncertainty;
+            if (tokens.size() != 4 || !parseConfigNumber(tokens[3], uncertainty) || !(uncertainty >= 0 && uncertainty <= 1)) {
+                fail("expected \"systematic <name> <lumi|xsec:<dataset|group>|dataset|*> <relative uncertainty>\"");
+                continue;
+            }
+            weightVariation up{tokens[1].text + "Up", {}}, down{tokens[1].text + "Down", {}};
+            up.scale(tokens[2].text, 1. + uncertainty);
+            down.scale(tokens[2].text, 1. - uncertainty);
+            for (const auto & variation : {up, down}) {
+                for (const auto & other : cfg.variations)
+                    if (other.name == variation.name) fail("variation " + variation.name + " defined twice");
+                cfg.variations.push_back(variation);
+            }
+        }
+
+        // group <name> <dataset>... ["legend"]
+        else if (directive == "group") {
+            size_t nDatasets = tokens.size();
+            std::string legend;
+            if (nDatasets > 0 && tokens.back().quoted) {
+                legend = tokens.back().text;
+                --nDatasets;
+            }
+            if (nDatasets < 3) {
+                fail("expected \"group <name> <dataset>... [\"legend\"]\"");
+                continue;
+            }
+            datasetGroup group{tokens[1].text, {}, legend};
+            for (size_t k = 2; k < nDatasets; ++k)
+                group.datasets.push_back(tokens[k].text);
+            for (const auto & other : cfg.groups)
+                if (other.name == group.name) fail("group " + group.name + " defined twice");
+            cfg.groups.push_back(group);
+        }
+
+        // ntuple <dataset|data> <tree> <file>...
+        else if (directive == "ntuple") {
+            if (tokens.size() < 4) {
+                fail("expected \"ntuple <dataset|data> <tree> <file>...\"");
+                continue;
+            }
+            ntupleSource source{tokens[1].text, tokens[2].text, {}};
+            for (size_t k = 3; k < tokens.size(); ++k)
+                source.files.push_back(tokens[k].text);
+            for (const auto & other : cfg.ntuples)
+                if (other.dataset == source.dataset) fail("ntuple of " + source.dataset + " defined twice");
+            cfg.ntuples.push_back(source);
+        }
+
+        // region <mass> "<selection>"
+        else if (directive == "region") {
+            if (tokens.size() != 3) {
+                fail("expected \"region <mass> \\\"<selection>\\\"\"");
+                continue;
+            }
+            if (cfg.regions.count(tokens[1].text))
+                fail("selection of mass region " + tokens[1].text + " defined twice");
+            cfg.regions[tokens[1].text] = tokens[2].text;
+        }
+
+        // book <sample> "<expression>" <bins> <low> <high> ["<selection>"]
+        else if (directive == "book") {
+            bookingStruct booking;
+            double nBins;
+            if (tokens.size() < 6 || tokens.size() > 7 || !parseConfigNumber(tokens[3], nBins) ||
+                !parseConfigNumber(tokens[4], booking.lo) || !parseConfigNumber(tokens[5], booking.hi)) {
+                fail("expected \"book <sample> \\\"<expression>\\\" <bins> <low> <high> [\\\"<selection>\\\"]\"");
+                continue;
+            }
+            booking.expression = tokens[2].text;
+            booking.nBins      = int(nBins);
+            if (tokens.size() == 7)
+                booking.selection = tokens[6].text;
+            if (booking.nBins < 1 || booking.nBins != nBins || !(booking.hi > booking.lo))
+                fail("sample " + tokens[1].text + " needs a positive number of bins and low < high");
+            if (cfg.bookings.count(tokens[1].text))
+                fail("booking of sample " + tokens[1].text + " defined twice");
+            cfg.bookings[tokens[1].text] = booking;
+        }
+
+        else
+            fail("unknown directive \"" + directive + "\"");
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Compute the weights in the same order as "lumi / events * cross section * factors"
+    for (size_t k = 0; k < cfg.datasets.size(); ++k) {
+        const auto &entry = datasetLines[k];
+        lineNumber = entry.line;
+        Double_t weight = cfg.lumi / entry.nGenerated * entry.crossSection;
+        Double_t factor = 1;
+        for (double f : entry.factors) {
+            weight *= f;
+            factor *= f;
+        }
+        dataStruct &data  = cfg.datasets[k];
+        data.weight       = weight;
+        data.lumi         = cfg.lumi;
+        data.nGenerated   = entry.nGenerated;
+        data.crossSection = entry.crossSection;
+        data.factor       = factor;
+        if (!std::isfinite(weight) || weight < 0)
+            fail("dataset " + cfg.datasets[k].name + " has an invalid weight");
+    }
+
+    // Cross-checks between the tables
+    lineNumber = 0;
+    if (cfg.lumi <= 0)        fail("missing \"lumi\" line");
+    if (cfg.massList.empty()) fail("no mass region defined");
+    if (cfg.datasets.empty()) fail("no dataset defined");
+    if (cfg.samples.empty())  fail("no sample defined");
+    for (const auto & entry : cfg.used)
+        for (const auto & name : entry.second) {
+            bool found = false;
+            for (const auto & data : cfg.datasets)
+                found |= data.name == name;
+            if (!found) fail("\"use " + entry.first + "\" refers to unknown dataset " + name);
+        }
+    for (const auto & variation : cfg.variations)
+        for (const auto & scale : variation.scales) {
+            bool found = scale.first == "*";
+            for (const auto & data : cfg.datasets)
+                found |= data.name == scale.first;
+            if (!found) fail("variation " + variation.name + " refers to unknown dataset " + scale.first);
+        }
+    std::map<std::string, std::string> groupOf;
+    for (const auto & group : cfg.groups)
+        for (const auto & name : group.datasets) {
+            bool found = false;
+            for (const auto & data : cfg.datasets)
+                found |= data.name == name;
+            if (!found) fail("group " + group.name + " refers to unknown dataset " + name);
+            if (groupOf.count(name)) fail("dataset " + name + " is in groups " + groupOf[name] + " and " + group.name);
+            groupOf[name] = group.name;
+        }
+    for (auto & variation : cfg.variations) {
+        std::map<std::string, double> crossSections;
+        for (const auto & xsec : variation.crossSections) {
+            bool found = false;
+            for (const auto & data : cfg.datasets)
+                found |= data.name == xsec.first;
+            if (found) {
+                crossSections.emplace(xsec.first, 1.).first->second *= xsec.second;
+                continue;
+            }
+            for (const auto & group : cfg.groups)
+                if (group.name == xsec.first) {
+                    for (const auto & name : group.datasets)
+                        crossSections.emplace(name, 1.).first->second *= xsec.second;
+                    found = true;
+                }
+            if (!found) fail("variation " + variation.name + " refers to unknown dataset or group " + xsec.first);
+        }
+        variation.crossSections = crossSections;
+    }
+    for (const auto & entry : viewLines) {
+        lineNumber = entry.line;
+        auto sample = cfg.samples.find(entry.sample);
+        auto master = cfg.samples.find(entry.view.master);
+        if (sample == cfg.samples.end())
+            fail("view of unknown sample " + entry.sample);
+        else if (master == cfg.samples.end())
+            fail("view " + entry.sample + " of unknown master sample " + entry.view.master);
+        else if (sample->second.derived())
+            fail("view of sample " + entry.sample + " defined twice");
+        else
+            sample->second.view = entry.view;
+    }
+    for (const auto & entry : viewLines) {
+        auto master = cfg.samples.find(entry.view.master);
+        if (master != cfg.samples.end() && master->second.derived()) {
+            lineNumber = entry.line;
+            fail("view " + entry.sample + " has master " + entry.view.master + ", which is a view itself");
+        }
+    }
+    lineNumber = 0;
+    for (const auto & source : cfg.ntuples) {
+        bool found = source.dataset == "data";
+        for (const auto & data : cfg.datasets)
+            found |= data.name == source.dataset;
+        if (!found) fail("ntuple of unknown dataset " + source.dataset);
+    }
+    for (const auto & region : cfg.regions)
+        if (std::find(cfg.massList.begin(), cfg.massList.end(), region.first) == cfg.massList.end())
+            fail("selection of unknown mass region " + region.first);
+    for (const auto & booking : cfg.bookings)
+        if (!cfg.samples.count(booking.first)) fail("booking of unknown sample " + booking.first);
+        else if (cfg.samples[booking.first].derived()) fail("sample " + booking.first + " is a view and can't be booked");
+
+    return nErrors == 0;
+}
+
+#endif //CONFIG_H
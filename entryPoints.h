@@ -0,0 +1,28 @@
+#ifndef ENTRYPOINTS_H
+#define ENTRYPOINTS_H
+
+
+#include <string>
+
+// Entry points of the analysis library. When the .cpp files are run as ROOT macros the default
+// arguments are the ones in their definitions; the compiled executables pass every argument. Each
+// returns false if it failed, after reporting why
+bool Graph(const std::string& outputFolder, const char* datafile, unsigned nWorkers, bool incremental,
+           const char* configFile, bool stacked, const char* format, bool headless);
+bool Norm(const char* datafile, const char* configFile);
+bool NormAll(const char* datafile, const char* outputFile, const char* configFile, bool stacked);
+bool Systematics(const char* datafile, const char* outputFile, const char* normFile, const char* fitFile,
+                 const char* configFile);
+bool Fit(const char* configFile, const char* cacheFile);
+bool FitScan(const char* datafile, const char* outputFile, unsigned nWorkers, const char* configFile,
+             const char* cacheFile);
+bool FitToys(int nToys, unsigned nWorkers, unsigned seed, const char* outputFile, const char* configFile,
+             const char* cacheFile);
+bool TemplateFit(const char* outputFile, const char* configFile);
+bool Produce(const char* outputFile, unsigned nThreads, const char* configFile);
+bool Export(const char* datafile, const char* outputFile);
+bool Synthesize(const char* outputFile, int nBins, double scale, unsigned seed, const char* configFile);
+bool Benchmark(const char* workFolder, int nBins, double scale, unsigned nWorkers, int nRepeats, unsigned seed,
+               const char* configFile);
+
+#endif //ENTRYPOINTS_H
@@ -0,0 +1,109 @@
+#ifndef FITCACHE_H
+#define FITCACHE_H
+
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <unistd.h>
+
+// Starting point of a fit: value and error of the free parameters in the order of par[4][2]
+// (dissociative A and B, exclusive A and B)
+struct fitStart {
+    double value[4];
+    double error[4];
+};
+
+// Persistent cache of fit results, stored as "<sequence> <sample> <mass> <inputs hash> <value error>..."
+// lines. Fits of the same inputs start from their previous optimum; fits of a (sample, mass region) whose
+// inputs changed start from its most recent result, the one with the highest sequence number. An empty
+// path disables it. Only the maxPerFit most recent results of every (sample, mass region) are kept, e.g.
+// one per weight variation of a fit campaign, so results of inputs tuned away are dropped instead of
+// piling up. The file is replaced atomically by save(), so concurrent jobs never leave a partial file,
+// but the last one to save wins
+class fitCache {
+public:
+    static constexpr size_t defaultPerFit = 32;
+
+    explicit fitCache(std::string path, size_t maxPerFit = defaultPerFit)
+        : path(std::move(path)), maxPerFit(std::max<size_t>(maxPerFit, 1)) {
+        if (this->path.empty())
+            return;
+        std::ifstream in(this->path);
+        unsigned long sequence;
+        std::string sample, mass, hash;
+        fitStart start;
+        while (in >> sequence >> sample >> mass >> hash) {
+            for (int k = 0; k < 4; ++k)
+                in >> start.value[k] >> start.error[k];
+            if (!in) break;
+            insert(sample, mass, hash, start, sequence);
+        }
+    }
+
+    const fitStart* find(const std::string& sample, const std::string& mass, const std::string& hash) const {
+        auto exact = entries.find(sample + " " + mass + " " + hash);
+        if (exact != entries.end())
+            return &exact->second.start;
+        auto last = history.find(sample + " " + mass);
+        return last != history.end() ? &entries.at(last->second.rbegin()->second).start : nullptr;
+    }
+
+    void store(const std::string& sample, const std::string& mass, const std::string& hash, const fitStart& start) {
+        insert(sample, mass, hash, start, lastSequence + 1);
+    }
+
+    // Write every entry to a temporary file renamed over the cache. Returns false if it couldn't be written
+    bool save() const {
+        if (path.empty())
+            return false;
+        const std::string temporary = path + ".tmp." + std::to_string(getpid());
+        std::ofstream out(temporary);
+        out.precision(17);
+        for (const auto & entry : entries) {
+            out << entry.second.sequence << " " << entry.first;
+            for (int k = 0; k < 4; ++k)
+                out << " " << entry.second.start.value[k] << " " << entry.second.start.error[k];
+            out << "\n";
+        }
+        out.close();
+        const bool ok = out && std::rename(temporary.c_str(), path.c_str()) == 0;
+        if (!ok)
+            std::remove(temporary.c_str());
+        return ok;
+    }
+
+private:
+    struct entry {
+        unsigned long sequence;
+        fitStart      start;
+    };
+
+    // Add or replace a result, then drop the oldest results of its (sample, mass region) beyond maxPerFit
+    void insert(const std::string& sample, const std::string& mass, const std::string& hash, const fitStart& start,
+                unsigned long sequence) {
+        const std::string key = sample + " " + mass + " " + hash;
+        auto &results = history[sample + " " + mass];
+        auto previous = entries.find(key);
+        if (previous != entries.end())
+            results.erase(previous->second.sequence);
+        entries[key] = {sequence, start};
+        results[sequence] = key;
+        while (results.size() > maxPerFit) {
+            entries.erase(results.begin()->second);
+            results.erase(results.begin());
+        }
+        lastSequence = std::max(lastSequence, sequence);
+    }
+
+    std::string path;
+    size_t      maxPerFit;
+    std::map<std::string, entry> entries;
+    std::map<std::string, std::map<unsigned long, std::string>> history;
+    unsigned long lastSequence = 0;
+};
+
+#endif //FITCACHE_H
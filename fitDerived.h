@@ -0,0 +1,99 @@
+#ifndef FITDERIVED_H
+#define FITDERIVED_H
+
+
+#include <algorithm>
+#include <cmath>
+
+// Closed-form integrals of x^n*exp(-B*x*x) between lo and hi, for the moments used after the fit.
+// For a vanishing slope the first two terms of the expansion of exp(-B*x*x) are used instead
+inline double ptSqExpMoment(int n, double slope, double lo, double hi) {
+    if (std::abs(slope) * hi * hi < 1e-6)
+        return (std::pow(hi, n + 1) - std::pow(lo, n + 1)) / (n + 1) -
+               slope * (std::pow(hi, n + 3) - std::pow(lo, n + 3)) / (n + 3);
+
+    const double rootB = std::sqrt(slope);
+    auto primitive = [&](double x) -> double {
+        const double gauss = std::exp(-slope * x * x);
+        switch (n) {
+            case 1:  return -gauss / (2 * slope);
+            case 2:  return std::sqrt(M_PI) / (4 * slope * rootB) * std::erf(rootB * x) - x * gauss / (2 * slope);
+            case 3:  return -(slope * x * x + 1) * gauss / (2 * slope * slope);
+            case 4:  return 3 * std::sqrt(M_PI) / (8 * slope * slope * rootB) * std::erf(rootB * x) -
+                            x * gauss * (2 * slope * x * x + 3) / (4 * slope * slope);
+            default: return std::nan("");
+        }
+    };
+    return primitive(hi) - primitive(lo);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+struct derivedValue {
+    double value;
+    double error;
+};
+
+// Quantities derived from the fit of A_dis*x*exp(-B_dis*x*x) + A_exc*x*exp(-B_exc*x*x), with the
+// errors propagated from the covariance matrix of (A_dis, B_dis, A_exc, B_exc):
+//  - par: the A values normalized to 10 times the integral of x*exp(-B*x*x) in [normLo, normHi],
+//         and the B values, as in par[4][2]
+//  - integral: 10 times the integral of the normalized sum in [lo, hi]
+//  - mean: mean of x for the normalized sum in [lo, hi]
+struct fitDerived {
+    derivedValue par[4];
+    derivedValue integral;
+    derivedValue mean;
+};
+
+inline fitDerived deriveQuantities(const double theta[4], const double cov[4][4],
+                                   double normLo = 0, double normHi = 2, double lo = 0, double hi = 3) {
+
+    // Error of a quantity from its gradient with respect to (A_dis, B_dis, A_exc, B_exc)
+    auto propagate = [&](const double gradient[4]) {
+        double variance = 0;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                variance += gradient[i] * cov[i][j] * gradient[j];
+        return std::sqrt(std::max(variance, 0.));
+    };
+
+    fitDerived result{};
+    double yield = 0, moment = 0, yieldGradient[4] = {}, momentGradient[4] = {};
+
+    // Dissociative component uses (theta[0], theta[1]), exclusive component (theta[2], theta[3]).
+    // The derivative of the integral of x^n*exp(-B*x*x) with respect to B is minus the one of x^(n+2)
+    for (int c = 0; c < 4; c += 2) {
+        const double A = theta[c], B = theta[c + 1];
+        const double norm  = ptSqExpMoment(1, B, normLo, normHi), dNorm  = -ptSqExpMoment(3, B, normLo, normHi);
+        const double area  = ptSqExpMoment(1, B, lo, hi),         dArea  = -ptSqExpMoment(3, B, lo, hi);
+        const double first = ptSqExpMoment(2, B, lo, hi),         dFirst = -ptSqExpMoment(4, B, lo, hi);
+
+        double gradient[4] = {};
+        gradient[c]     = 1 / (10 * norm);
+        gradient[c + 1] = -A * dNorm / (10 * norm * norm);
+        result.par[c] = {A / (10 * norm), propagate(gradient)};
+
+        gradient[c] = 0;
+        gradient[c + 1] = 1;
+        result.par[c + 1] = {B, propagate(gradient)};
+
+        yield  += A * area / norm;
+        moment += A * first / norm;
+        yieldGradient[c]      = area / norm;
+        yieldGradient[c + 1]  = A * (dArea * norm - area * dNorm) / (norm * norm);
+        momentGradient[c]     = first / norm;
+        momentGradient[c + 1] = A * (dFirst * norm - first * dNorm) / (norm * norm);
+    }
+
+    result.integral = {yield, propagate(yieldGradient)};
+
+    const double mean = moment / yield;
+    double meanGradient[4];
+    for (int i = 0; i < 4; ++i)
+        meanGradient[i] = (momentGradient[i] - mean * yieldGradient[i]) / yield;
+    result.mean = {mean, propagate(meanGradient)};
+    return result;
+}
+
+#endif //FITDERIVED_H
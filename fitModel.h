@@ -0,0 +1,201 @@
+#ifndef FITMODEL_H
+#define FITMODEL_H
+
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TH1.h"
+#include "TH1F.h"
+#include "RooAddPdf.h"
+#include "RooDataHist.h"
+#include "RooFitResult.h"
+#include "RooGlobalFunc.h"
+#include "RooRealVar.h"
+#include "TMatrixDSym.h"
+
+#include "datatypes.h"
+#include "fitCache.h"
+#include "fitDerived.h"
+#include "inputHash.h"
+#include "perfReport.h"
+#include "histProvider.h"
+#include "RooPtSqExpPdf.h"
+
+// Histograms used by one exclusive/dissociative fit: the data and the weighted sums of the exclusive
+// (isUsed = 1) and dissociative (isUsed = 0) datasets
+struct fitInputs {
+    std::unique_ptr<TH1> data, exc, dis;
+    Double_t upperLimit = 0;
+};
+
+// Read the fit inputs of a (sample, mass region). Each dataset weight is multiplied by its entry in
+// scales, if there is one
+inline bool readFitInputs(histProvider& provider, const std::string& sampleName, const std::string& mass,
+                          const std::vector<dataStruct>& dataset, fitInputs& in,
+                          const std::map<std::string, double>& scales = {}) {
+
+    // Read the experimental data
+    in.data.reset(provider.copy(sampleName, mass, "data"));
+    if (!in.data)
+        return false;
+
+    // Get the max value of the x-axis
+    const int nBins = in.data->GetNbinsX();
+    in.upperLimit = in.data->GetBinCenter(nBins) + in.data->GetBinWidth(nBins) / 2;
+
+    // Create two empty histograms that hold the exclusive and dissociative data
+    in.exc = std::make_unique<TH1F>("excHist", "Exclusive", nBins, 0, in.upperLimit);
+    in.dis = std::make_unique<TH1F>("disHist", "Dissociative", nBins, 0, in.upperLimit);
+    in.exc->SetDirectory(nullptr);
+    in.dis->SetDirectory(nullptr);
+
+    // Fill the histograms
+    for (const dataStruct& simData : dataset) {
+        auto scale = scales.find(simData.name);
+        auto h = provider.get(sampleName, mass, simData.name,
+                              simData.weight * (scale == scales.end() ? 1. : scale->second));
+        if (!h) continue;
+        perfTimer timer("add");
+        if (simData.isUsed == 0)
+            in.dis->Add(h.get());
+        else
+            in.exc->Add(h.get());
+    }
+    return true;
+}
+
+// Hash of the fit inputs, used as key of the fit cache
+inline inputHash hashFitInputs(const fitInputs& in) {
+    inputHash hash;
+    hash.add(in.data.get()).add(in.exc.get()).add(in.dis.get());
+    return hash;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// RooFit objects of one exclusive/dissociative fit. Each fit owns its own instance, so independent fits
+// never share RooFit state
+class fitModel {
+public:
+    fitModel(const char* title, Double_t upperLimit)
+        : x("x", title, 0, upperLimit),
+          excA("excA", "exclusive A value", 1, 0, 10000),
+          excB("excB", "exclusive B value", 1, 0, 100),
+          disA("disA", "dissociative A value", 1, 0, 10000),
+          disB("disB", "dissociative B value", 1, 0, 100),
+          excFit("excFit", "excFit", x, excB),
+          disFit("disFit", "disFit", x, disB),
+          finalPDF("finalPDF", "finalPDF", RooArgList(excFit, disFit), RooArgList(excA, disA)) {}
+
+    // Warm-started fit: the parameters start from a previous optimum, with its errors as initial step
+    // sizes, so the template fits that only provide starting values are skipped
+    int fit(const fitInputs& in, const fitStart& start) {
+        data = std::make_unique<RooDataHist>("data", "Experimental data", x, in.data.get());
+        setStart(start);
+        return fitData(*data);
+    }
+
+    // Fit each template to its own histogram, defining the "B" parameters, then fit the sum of both
+    // to the data. Returns the status of the final fit
+    int fit(const fitInputs& in) {
+        data = std::make_unique<RooDataHist>("data", "Experimental data", x, in.data.get());
+        fitTemplates(in);
+        return fitData(*data);
+    }
+
+    // Fit x*exp(-B*x*x) to the exclusive and dissociative histograms
+    void fitTemplates(const fitInputs& in) {
+        using namespace RooFit;
+        perfTimer timer("fit templates");
+        RooDataHist exc("exc", "Exclusive fit", x, in.exc.get());
+        RooDataHist dis("dis", "Dissociative fit", x, in.dis.get());
+        disFit.fitTo(dis, PrintLevel(-1));
+        excFit.fitTo(exc, PrintLevel(-1));
+    }
+
+    // Fit the sum of both templates to a (data or toy) histogram. Returns the fit status
+    int fitData(RooDataHist& hist) {
+        using namespace RooFit;
+        perfTimer timer("fit data");
+        result.reset(finalPDF.fitTo(hist, PrintLevel(-1), Save()));
+        return result ? result->status() : -1;
+    }
+
+    // Free parameters in the order of par[4][2]: dissociative A and B, exclusive A and B
+    std::array<RooRealVar*, 4> parameters() { return {&disA, &disB, &excA, &excB}; }
+
+    // Current parameter values and errors, to be cached or used as the start of another fit
+    fitStart snapshot() {
+        fitStart start;
+        auto params = parameters();
+        for (int k = 0; k < 4; ++k) {
+            start.value[k] = params[k]->getVal();
+            start.error[k] = params[k]->getError();
+        }
+        return start;
+    }
+
+    void setStart(const fitStart& start) {
+        auto params = parameters();
+        for (int k = 0; k < 4; ++k) {
+            params[k]->setVal(start.value[k]);
+            if (start.error[k] > 0)
+                params[k]->setError(start.error[k]);
+        }
+    }
+
+    // Covariance matrix of (A_dis, B_dis, A_exc, B_exc) from the last fit to the data. Without a saved
+    // result only the diagonal, from the parameter errors, is filled
+    void covariance(double cov[4][4]) {
+        auto params = parameters();
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                cov[i][j] = i == j ? params[i]->getError() * params[i]->getError() : 0;
+        if (!result)
+            return;
+
+        const TMatrixDSym &matrix = result->covarianceMatrix();
+        const RooArgList &floating = result->floatParsFinal();
+        for (int i = 0; i < 4; ++i) {
+            const int row = floating.index(params[i]->GetName());
+            for (int j = 0; j < 4; ++j) {
+                const int column = floating.index(params[j]->GetName());
+                if (row >= 0 && column >= 0)
+                    cov[i][j] = matrix(row, column);
+            }
+        }
+    }
+
+    // Normalized A values, integral in [0, 3] and mean, with errors propagated from the covariance
+    fitDerived derived() {
+        double theta[4], cov[4][4];
+        auto params = parameters();
+        for (int k = 0; k < 4; ++k)
+            theta[k] = params[k]->getVal();
+        covariance(cov);
+        return deriveQuantities(theta, cov);
+    }
+
+    // Fit results and errors: dissociative A and B, exclusive A and B. The A values are normalized to
+    // the integral of x*exp(-B*x*x) between 0 and 2
+    void results(double par[4][2]) {
+        const fitDerived quantities = derived();
+        for (int k = 0; k < 4; ++k) {
+            par[k][0] = quantities.par[k].value;
+            par[k][1] = quantities.par[k].error;
+        }
+    }
+
+
+    RooRealVar    x, excA, excB, disA, disB;
+    RooPtSqExpPdf excFit, disFit;
+    RooAddPdf     finalPDF;
+
+    std::unique_ptr<RooDataHist>  data;
+    std::unique_ptr<RooFitResult> result;
+};
+
+#endif //FITMODEL_H
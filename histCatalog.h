@@ -0,0 +1,202 @@
+#ifndef HISTCATALOG_H
+#define HISTCATALOG_H
+
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glob.h>
+#include "TFile.h"
+#include "TKey.h"
+#include "TH1.h"
+#include "TROOT.h"
+#include "TError.h"
+
+#include "histMap.h"
+#include "perfReport.h"
+
+// Index of every histogram stored in the data files. Each file is opened and its key directory is
+// parsed only once per run; afterwards each "<sample>_<mass>_<dataset>" lookup is a single hash table
+// access. A ".hmap" export (see histMap.h) is memory mapped instead, and its histograms are built from
+// the mapped arrays without any ROOT deserialization.
+// The datafile may be a comma separated list of files and wildcards, e.g. "out/*.root" with one file
+// per dataset as produced, so they don't have to be merged with hadd first. The files are opened and
+// indexed concurrently, and every key is looked up in the file holding it; a key found in several
+// files is taken from the first one listed. A missing file or a wildcard matching no file rejects the
+// whole input
+class histCatalog {
+public:
+    explicit histCatalog(const char* datafile) {
+        perfTimer timer("open");
+        std::vector<std::string> paths;
+        if (!inputFiles(datafile, paths))
+            return;
+
+        sources.resize(paths.size());
+        for (size_t k = 0; k < paths.size(); ++k) {
+            sources[k] = std::make_unique<source>();
+            sources[k]->path = paths[k];
+        }
+        if (sources.size() == 1)
+            sources[0]->open();
+        else {
+            ROOT::EnableThreadSafety();
+            std::atomic<size_t> next{0};
+            std::vector<std::thread> threads(std::min<size_t>(sources.size(), std::max(1u, std::thread::hardware_concurrency())));
+            for (auto & thread : threads)
+                thread = std::thread([&] {
+                    for (size_t k = next++; k < sources.size(); k = next++)
+                        sources[k]->open();
+                });
+            for (auto & thread : threads)
+                thread.join();
+        }
+
+        // A missing file makes the whole input unusable, instead of silently dropping its datasets
+        for (const auto & input : sources)
+            if (!input->isOpen()) {
+                sources.clear();
+                return;
+            }
+
+        // Merge the indices in the order the files are listed
+        for (const auto & input : sources) {
+            size_t nDuplicates = 0;
+            for (const auto & key : input->keys)
+                nDuplicates += !index.emplace(key.first, location{input.get(), key.second}).second;
+            for (const auto & name : input->mapped)
+                nDuplicates += !index.emplace(name, location{input.get(), nullptr}).second;
+            if (nDuplicates)
+                Warning("histCatalog", "%zu keys of %s are also in a previous file, ignored", nDuplicates, input->path.c_str());
+        }
+    }
+
+    bool isOpen() const { return !sources.empty(); }
+    size_t size() const { return index.size(); }
+
+    bool contains(const std::string& name) const { return index.count(name) != 0; }
+
+    // Names of every key, in no particular order
+    std::vector<std::string> names() const {
+        std::vector<std::string> all;
+        all.reserve(index.size());
+        for (const auto & entry : index)
+            all.push_back(entry.first);
+        return all;
+    }
+
+    // Read a fresh copy of the histogram, detached from the file and owned by the caller.
+    // Returns nullptr if the key does not exist or does not hold a histogram
+    TH1* get(const std::string& name) const {
+        auto it = index.find(name);
+        if (it == index.end())
+            return nullptr;
+        perfTimer timer("read");
+        if (!it->second.key) {
+            histMapRecord record;
+            return it->second.input->map->find(name, record) ? record.histogram() : nullptr;
+        }
+        auto *h = it->second.key->ReadObject<TH1>();
+        if (h)
+            h->SetDirectory(nullptr);
+        return h;
+    }
+
+    TH1* get(const std::string& sample, const std::string& mass, const std::string& dataset) const {
+        return get(sample + "_" + mass + "_" + dataset);
+    }
+
+    // Files of a datafile specification: its comma separated entries, with the wildcards expanded in
+    // sorted order. An entry without wildcards is kept as it is, so a missing file is reported on open.
+    // Returns false if the specification is empty or a wildcard matches no file, since its datasets
+    // would be silently missing
+    static bool inputFiles(const std::string& spec, std::vector<std::string>& files) {
+        files.clear();
+        bool complete = true;
+        size_t begin = 0;
+        while (begin <= spec.size()) {
+            size_t end = spec.find(',', begin);
+            if (end == std::string::npos) end = spec.size();
+            const std::string entry = spec.substr(begin, end - begin);
+            begin = end + 1;
+            if (entry.empty())
+                continue;
+            if (entry.find_first_of("*?[") == std::string::npos) {
+                files.push_back(entry);
+                continue;
+            }
+            glob_t matches;
+            if (glob(entry.c_str(), 0, nullptr, &matches) == 0)
+                for (size_t k = 0; k < matches.gl_pathc; ++k)
+                    files.emplace_back(matches.gl_pathv[k]);
+            else {
+                Error("histCatalog", "No file matches %s", entry.c_str());
+                complete = false;
+            }
+            globfree(&matches);
+        }
+        if (files.empty() && complete) {
+            Error("histCatalog", "No input file in \"%s\"", spec.c_str());
+            complete = false;
+        }
+        return complete;
+    }
+
+    static bool isHistMap(const std::string& path) {
+        const std::string suffix = ".hmap";
+        return path.size() > suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+private:
+    // One input file with its own index: the highest cycle of every key of a ROOT file, or the names
+    // of a memory mapped export
+    struct source {
+        std::string                            path;
+        std::unique_ptr<TFile>                 file;
+        std::unique_ptr<histMapReader>         map;
+        std::unordered_map<std::string, TKey*> keys;
+        std::vector<std::string>               mapped;
+
+        bool isOpen() const { return file != nullptr || map != nullptr; }
+
+        void open() {
+            if (isHistMap(path)) {
+                map = std::make_unique<histMapReader>(path.c_str());
+                if (!map->isOpen()) {
+                    map.reset();
+                    return;
+                }
+                for (const auto & record : map->records())
+                    mapped.emplace_back(record.name);
+                return;
+            }
+            file.reset(TFile::Open(path.c_str()));
+            if (!file || file->IsZombie()) {
+                Error("histCatalog", "Cannot open %s", path.c_str());
+                file.reset();
+                return;
+            }
+            for (TObject* obj : *file->GetListOfKeys()) {
+                auto *key = static_cast<TKey*>(obj);
+                auto &entry = keys[key->GetName()];
+                if (!entry || entry->GetCycle() < key->GetCycle())
+                    entry = key;
+            }
+        }
+    };
+
+    // File holding a key, and the key itself for a ROOT file
+    struct location {
+        const source *input;
+        TKey         *key;
+    };
+
+    std::vector<std::unique_ptr<source>>      sources;
+    std::unordered_map<std::string, location> index;
+};
+
+#endif //HISTCATALOG_H
@@ -0,0 +1,296 @@
+#ifndef HISTMAP_H
+#define HISTMAP_H
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "TH1.h"
+#include "TH1D.h"
+#include "TError.h"
+
+// Memory-mappable export of the 1D histograms of a data file (".hmap"), read without any ROOT
+// deserialization. Layout, in native byte order, every offset in bytes from the start of the file:
+//   header   magic "HISTMAP1", byte order mark 0x01020304, version, number of histograms, offsets of
+//            the index and of the string table
+//   data     for every histogram, contiguous float64 arrays of the nBins + 1 edges, then the nBins + 2
+//            contents and the nBins + 2 errors (underflow and overflow included), 8-byte aligned
+//   strings  names, titles and x-axis titles
+//   index    one histMapEntry per histogram, sorted by name ("<sample>_<mass>_<dataset>")
+struct histMapHeader {
+    char     magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t nHistograms;
+    uint64_t indexOffset;
+    uint64_t stringsOffset;
+};
+
+struct histMapEntry {
+    uint64_t nameOffset, titleOffset, xTitleOffset;
+    uint32_t nameLength, titleLength, xTitleLength;
+    int32_t  nBins;
+    uint64_t dataOffset;
+    double   entries;
+};
+
+static constexpr char     histMapMagic[8]  = {'H', 'I', 'S', 'T', 'M', 'A', 'P', '1'};
+static constexpr uint32_t histMapByteOrder = 0x01020304;
+static constexpr uint32_t histMapVersion   = 1;
+
+// Zero-copy view of one exported histogram, valid as long as its reader is open
+struct histMapRecord {
+    std::string_view name, title, xTitle;
+    int              nBins = 0;
+    double           entries = 0;
+    const double    *edges = nullptr, *contents = nullptr, *errors = nullptr;
+
+    // Detached TH1D with the same binning, contents and errors, owned by the caller. Uniform binnings
+    // are kept uniform
+    TH1D* histogram() const {
+        const double width = (edges[nBins] - edges[0]) / nBins;
+        bool uniform = true;
+        for (int bin = 0; bin < nBins && uniform; ++bin)
+            uniform = std::abs(edges[bin + 1] - edges[bin] - width) <= 1e-9 * std::abs(width);
+        auto *h = uniform ? new TH1D(std::string(name).c_str(), std::string(title).c_str(), nBins, edges[0], edges[nBins])
+                          : new TH1D(std::string(name).c_str(), std::string(title).c_str(), nBins, edges);
+        h->SetDirectory(nullptr);
+        h->Sumw2();
+        h->GetXaxis()->SetTitle(std::string(xTitle).c_str());
+        std::copy(contents, contents + nBins + 2, h->GetArray());
+        double *errors2 = h->GetSumw2()->GetArray();
+        for (int cell = 0; cell < nBins + 2; ++cell)
+            errors2[cell] = errors[cell] * errors[cell];
+        h->SetEntries(entries);
+        return h;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Read-only memory map of a ".hmap" file. Opening checks the header and the index; a lookup is a
+// binary search of the index and touches nothing but the pages of that histogram
+class histMapReader {
+public:
+    explicit histMapReader(const char* path) {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            Error("histMapReader", "Cannot open %s", path);
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(histMapHeader)) {
+            void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) {
+                base = static_cast<const char*>(mapped);
+                length = info.st_size;
+            }
+        }
+        ::close(fd);
+        if (!base || !validate()) {
+            Error("histMapReader", "%s is not a valid histogram map", path);
+            unmap();
+        }
+    }
+    histMapReader(const histMapReader&) = delete;
+    histMapReader& operator=(const histMapReader&) = delete;
+
+    ~histMapReader() { unmap(); }
+
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return isOpen() ? header().nHistograms : 0; }
+
+    // Record of a histogram. Returns false if there is none with that name
+    bool find(std::string_view name, histMapRecord& record) const {
+        if (!isOpen())
+            return false;
+        const histMapEntry *first = index(), *last = index() + header().nHistograms;
+        const histMapEntry *it = std::lower_bound(first, last, name, [this](const histMapEntry& e, std::string_view key) {
+            return text(e.nameOffset, e.nameLength) < key;
+        });
+        if (it == last || text(it->nameOffset, it->nameLength) != name)
+            return false;
+        record = this->record(*it);
+        return true;
+    }
+
+    bool find(const std::string& sample, const std::string& mass, const std::string& dataset, histMapRecord& record) const {
+        return find(sample + "_" + mass + "_" + dataset, record);
+    }
+
+    // Every record, in name order
+    std::vector<histMapRecord> records() const {
+        std::vector<histMapRecord> all;
+        for (size_t k = 0; k < size(); ++k)
+            all.push_back(record(index()[k]));
+        return all;
+    }
+
+private:
+    const histMapHeader& header() const { return *reinterpret_cast<const histMapHeader*>(base); }
+    const histMapEntry* index() const { return reinterpret_cast<const histMapEntry*>(base + header().indexOffset); }
+    std::string_view text(uint64_t offset, uint32_t size) const { return {base + offset, size}; }
+
+    histMapRecord record(const histMapEntry& e) const {
+        histMapRecord r;
+        r.name     = text(e.nameOffset, e.nameLength);
+        r.title    = text(e.titleOffset, e.titleLength);
+        r.xTitle   = text(e.xTitleOffset, e.xTitleLength);
+        r.nBins    = e.nBins;
+        r.entries  = e.entries;
+        r.edges    = reinterpret_cast<const double*>(base + e.dataOffset);
+        r.contents = r.edges + e.nBins + 1;
+        r.errors   = r.contents + e.nBins + 2;
+        return r;
+    }
+
+    // Check the header and that every entry points inside the file, so a truncated or foreign file
+    // is rejected when opened instead of crashing a lookup
+    bool validate() const {
+        const histMapHeader &h = header();
+        if (std::memcmp(h.magic, histMapMagic, sizeof(histMapMagic)) != 0 || h.byteOrder != histMapByteOrder ||
+            h.version != histMapVersion)
+            return false;
+        if (h.indexOffset % alignof(histMapEntry) != 0 || h.indexOffset > length ||
+            (length - h.indexOffset) / sizeof(histMapEntry) < h.nHistograms)
+            return false;
+        for (size_t k = 0; k < h.nHistograms; ++k) {
+            const histMapEntry &e = index()[k];
+            const uint64_t bytes = (3 * uint64_t(e.nBins) + 5) * sizeof(double);
+            if (e.nBins < 1 || e.dataOffset % alignof(double) != 0 || e.dataOffset + bytes > length ||
+                e.nameOffset + e.nameLength > length || e.titleOffset + e.titleLength > length ||
+                e.xTitleOffset + e.xTitleLength > length)
+                return false;
+        }
+        return true;
+    }
+
+    void unmap() {
+        if (base)
+            munmap(const_cast<char*>(base), length);
+        base = nullptr;
+        length = 0;
+    }
+
+    const char *base   = nullptr;
+    size_t      length = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Write the histograms in the ".hmap" layout. Data blocks are streamed to the file as they are added,
+// only the index and the strings are kept in memory until close(). The file is written under a
+// temporary name and renamed when complete, so a process mapping the previous version keeps it intact
+class histMapWriter {
+public:
+    explicit histMapWriter(const char* path)
+        : path(path), file(std::fopen((this->path + ".tmp").c_str(), "wb")) {
+        if (!file) {
+            Error("histMapWriter", "Cannot create %s", path);
+            return;
+        }
+        histMapHeader empty{};
+        std::fwrite(&empty, sizeof(empty), 1, file);
+        offset = sizeof(empty);
+    }
+    histMapWriter(const histMapWriter&) = delete;
+    histMapWriter& operator=(const histMapWriter&) = delete;
+
+    ~histMapWriter() { close(); }
+
+    bool isOpen() const { return file != nullptr; }
+
+    void add(const std::string& name, const TH1& h) {
+        const int nBins = h.GetNbinsX();
+        std::vector<double> data;
+        data.reserve(3 * nBins + 5);
+        for (int bin = 1; bin <= nBins + 1; ++bin)
+            data.push_back(h.GetXaxis()->GetBinLowEdge(bin));
+        for (int bin = 0; bin <= nBins + 1; ++bin)
+            data.push_back(h.GetBinContent(bin));
+        for (int bin = 0; bin <= nBins + 1; ++bin)
+            data.push_back(h.GetBinError(bin));
+
+        histMapEntry e{};
+        e.nBins      = nBins;
+        e.entries    = h.GetEntries();
+        e.dataOffset = offset;
+        std::fwrite(data.data(), sizeof(double), data.size(), file);
+        offset += data.size() * sizeof(double);
+
+        e.nameOffset   = addString(name, e.nameLength);
+        e.titleOffset  = addString(h.GetTitle(), e.titleLength);
+        e.xTitleOffset = addString(h.GetXaxis()->GetTitle(), e.xTitleLength);
+        entries.push_back(e);
+        names.push_back(name);
+    }
+
+    // Write the strings, the sorted index and the header. Returns false if the file couldn't be written
+    bool close() {
+        if (!file)
+            return false;
+        for (auto & e : entries) {
+            e.nameOffset   += offset;
+            e.titleOffset  += offset;
+            e.xTitleOffset += offset;
+        }
+        histMapHeader header{};
+        std::memcpy(header.magic, histMapMagic, sizeof(histMapMagic));
+        header.byteOrder     = histMapByteOrder;
+        header.version       = histMapVersion;
+        header.nHistograms   = entries.size();
+        header.stringsOffset = offset;
+        std::fwrite(strings.data(), 1, strings.size(), file);
+        offset += strings.size();
+
+        const uint64_t padding = (alignof(histMapEntry) - offset % alignof(histMapEntry)) % alignof(histMapEntry);
+        const char zeros[alignof(histMapEntry)] = {};
+        std::fwrite(zeros, 1, padding, file);
+        header.indexOffset = offset + padding;
+
+        std::vector<size_t> order(entries.size());
+        for (size_t k = 0; k < order.size(); ++k)
+            order[k] = k;
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return names[a] < names[b]; });
+        for (size_t k : order)
+            std::fwrite(&entries[k], sizeof(histMapEntry), 1, file);
+
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, file);
+        bool ok = !std::ferror(file);
+        ok &= std::fclose(file) == 0;
+        file = nullptr;
+        const std::string temporary = path + ".tmp";
+        if (ok)
+            ok = std::rename(temporary.c_str(), path.c_str()) == 0;
+        if (!ok)
+            std::remove(temporary.c_str());
+        return ok;
+    }
+
+private:
+    uint64_t addString(const std::string& text, uint32_t& length) {
+        const uint64_t position = strings.size();
+        strings.append(text);
+        length = text.size();
+        return position;
+    }
+
+    std::string               path;
+    std::FILE                *file = nullptr;
+    uint64_t                  offset = 0;
+    std::vector<histMapEntry> entries;
+    std::vector<std::string>  names;
+    std::string               strings;
+};
+
+#endif //HISTMAP_H
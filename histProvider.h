@@ -0,0 +1,188 @@
+#ifndef HISTPROVIDER_H
+#define HISTPROVIDER_H
+
+
+#include <cstdio>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "TH1.h"
+
+#include "datatypes.h"
+#include "histCatalog.h"
+#include "histView.h"
+#include "perfReport.h"
+
+// Lazy, memory-bounded access to the histograms of a data file. Only the key directory is read when
+// the provider is created; a histogram is deserialized the first time it is needed, scaled by its
+// weight and kept in a least recently used cache of at most maxBytes, so asking again for the same
+// weighted histogram doesn't touch the file. The samples declared as views (see histView.h) are not
+// read but computed from the weighted histogram of their master sample
+class histProvider {
+public:
+    static constexpr size_t defaultBytes = 256 << 20;
+
+    explicit histProvider(const char* datafile, size_t maxBytes = defaultBytes)
+        : dataCluster(datafile), maxBytes(maxBytes) {}
+    histProvider(const histProvider&) = delete;
+    histProvider& operator=(const histProvider&) = delete;
+
+    bool isOpen() const { return dataCluster.isOpen(); }
+    const histCatalog& catalog() const { return dataCluster; }
+
+    // Histogram scaled by weight, shared with the cache and valid as long as the pointer is held.
+    // Returns nullptr if the key does not exist. Views are only resolved by the (sample, mass, dataset)
+    // form, this one reads stored histograms
+    std::shared_ptr<const TH1> get(const std::string& name, double weight = 1.) {
+        return cached(name, weight, [&]() -> TH1* {
+            // A weighted histogram is scaled from the unweighted one if that is already cached, e.g. by
+            // another weight variation of the dataset. Otherwise it is read and scaled in place, so a
+            // dataset only ever used at its nominal weight is kept once, without an extra copy
+            TH1 *h = nullptr;
+            if (weight != 1. && index.count(cacheKey(name, 1.))) {
+                auto base = get(name, 1.);
+                h = static_cast<TH1*>(base->Clone());
+                h->SetDirectory(nullptr);
+            }
+            else
+                h = dataCluster.get(name);
+            if (h && weight != 1.) {
+                perfTimer timer("scale");
+                h->Scale(weight);
+            }
+            return h;
+        });
+    }
+
+    std::shared_ptr<const TH1> get(const std::string& sample, const std::string& mass, const std::string& dataset,
+                                   double weight = 1.) {
+        const std::string name = sample + "_" + mass + "_" + dataset;
+        auto view = views.find(sample);
+        if (view == views.end())
+            return get(name, weight);
+        return cached(name, weight, [&]() -> TH1* {
+            auto master = get(view->second.master, mass, dataset, weight);
+            return master ? deriveView(*master, view->second, name) : nullptr;
+        });
+    }
+
+    // Detached copy of the weighted histogram owned by the caller, to be styled and drawn
+    TH1* copy(const std::string& name, double weight = 1.) {
+        return detach(get(name, weight));
+    }
+
+    TH1* copy(const std::string& sample, const std::string& mass, const std::string& dataset, double weight = 1.) {
+        return detach(get(sample, mass, dataset, weight));
+    }
+
+    // Declare the derived samples of a configuration. Cached views are dropped if the views change
+    void setViews(const std::map<std::string, sampleStruct>& samples) {
+        std::map<std::string, sampleView> declared;
+        for (const auto & sample : samples)
+            if (sample.second.derived())
+                declared[sample.first] = sample.second.view;
+        if (declared == views)
+            return;
+        views = declared;
+        entries.clear();
+        index.clear();
+        usedBytes = 0;
+    }
+
+    void setMaxBytes(size_t bytes) { maxBytes = bytes; shrink(); }
+    size_t bytes() const { return usedBytes; }
+    size_t hits() const { return nHits; }
+    size_t misses() const { return nMisses; }
+
+    // Provider of a data file shared by every entry point run in the same session, so Graph(), Norm()
+    // and Fit() reuse each other's histograms. Forked workers must open their own provider instead,
+    // since the file descriptor of a shared one would be shared between processes
+    static histProvider& session(const std::string& datafile) {
+        auto &provider = sessions()[datafile];
+        if (!provider || !provider->isOpen())
+            provider = std::make_unique<histProvider>(datafile.c_str());
+        return *provider;
+    }
+
+    // Drop the shared provider of a data file, e.g. before the file is written again
+    static void closeSession(const std::string& datafile) { sessions().erase(datafile); }
+
+private:
+    // Cached histogram of a name and weight, made by load() (returning a new histogram, or nullptr)
+    // when it isn't cached
+    template <typename Loader>
+    std::shared_ptr<const TH1> cached(const std::string& name, double weight, Loader&& load) {
+        const std::string key = cacheKey(name, weight);
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            ++nHits;
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->hist;
+        }
+
+        ++nMisses;
+        std::shared_ptr<const TH1> h(load());
+        if (!h)
+            return nullptr;
+        entries.push_front({key, h, footprint(*h)});
+        index[key] = entries.begin();
+        usedBytes += entries.front().bytes;
+        shrink();
+        return h;
+    }
+
+    static std::string cacheKey(const std::string& name, double weight) {
+        char weightKey[32];
+        snprintf(weightKey, sizeof(weightKey), "@%a", weight);
+        return name + weightKey;
+    }
+
+    static TH1* detach(const std::shared_ptr<const TH1>& h) {
+        if (!h)
+            return nullptr;
+        perfTimer timer("copy");
+        auto *clone = static_cast<TH1*>(h->Clone());
+        clone->SetDirectory(nullptr);
+        return clone;
+    }
+
+    struct entry {
+        std::string                key;
+        std::shared_ptr<const TH1> hist;
+        size_t                     bytes;
+    };
+
+    // Approximate memory used by a histogram: the object and its contents and errors in double precision
+    static size_t footprint(const TH1& h) {
+        return sizeof(TH1) + size_t(h.GetNcells()) * sizeof(Double_t) * (h.GetSumw2N() ? 2 : 1);
+    }
+
+    // Evict the least recently used histograms until the cache fits, always keeping the newest one
+    void shrink() {
+        while (usedBytes > maxBytes && entries.size() > 1) {
+            usedBytes -= entries.back().bytes;
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    // Never destroyed, so no file is deleted after ROOT has been torn down at exit
+    static std::map<std::string, std::unique_ptr<histProvider>>& sessions() {
+        static auto *providers = new std::map<std::string, std::unique_ptr<histProvider>>;
+        return *providers;
+    }
+
+    histCatalog                       dataCluster;
+    std::map<std::string, sampleView> views;
+    size_t                            maxBytes;
+    size_t                            usedBytes = 0, nHits = 0, nMisses = 0;
+
+    std::list<entry>                                          entries;
+    std::unordered_map<std::string, std::list<entry>::iterator> index;
+};
+
+#endif //HISTPROVIDER_H
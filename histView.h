@@ -0,0 +1,86 @@
+#ifndef HISTVIEW_H
+#define HISTVIEW_H
+
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "TH1.h"
+#include "TH1D.h"
+#include "TError.h"
+
+#include "datatypes.h"
+#include "perfReport.h"
+
+// Bin edges of a view: the given edges, or the master edges inside the zoom range, merged rebin by
+// rebin. A last incomplete group of master bins is left out, like TH1::Rebin does
+inline std::vector<double> viewEdges(const TH1& master, const sampleView& view) {
+    if (!view.edges.empty())
+        return view.edges;
+
+    const TAxis *axis = master.GetXaxis();
+    int first = 1, last = axis->GetNbins();
+    if (view.hi > view.lo) {
+        first = std::max(first, axis->FindFixBin(view.lo));
+        last  = axis->FindFixBin(view.hi);
+        if (last > axis->GetNbins() || view.hi <= axis->GetBinLowEdge(last))
+            --last;
+    }
+    std::vector<double> edges;
+    for (int bin = first; bin <= last + 1; bin += view.rebin)
+        edges.push_back(axis->GetBinLowEdge(bin));
+    return edges;
+}
+
+// Compute a view from its master histogram. Every master bin goes to the view bin holding its center,
+// so bins outside the view end in its underflow and overflow and the integral is kept; errors are
+// summed in quadrature. Returns a histogram owned by the caller, or nullptr if the view has no bin
+inline TH1D* deriveView(const TH1& master, const sampleView& view, const std::string& name) {
+    perfTimer timer("derive");
+    const std::vector<double> edges = viewEdges(master, view);
+    if (edges.size() < 2) {
+        Error("deriveView", "View %s of %s has no bin", name.c_str(), master.GetName());
+        return nullptr;
+    }
+
+    const TAxis *axis = master.GetXaxis();
+    const double tolerance = 1e-9 * (axis->GetXmax() - axis->GetXmin());
+    for (double edge : edges) {
+        const int bin = axis->FindFixBin(edge);
+        if (std::abs(axis->GetBinLowEdge(bin) - edge) > tolerance) {
+            Warning("deriveView", "Edge %g of %s is not an edge of %s, its master bins are split by their center",
+                    edge, name.c_str(), master.GetName());
+            break;
+        }
+    }
+
+    auto *h = new TH1D(name.c_str(), master.GetTitle(), int(edges.size()) - 1, edges.data());
+    h->SetDirectory(nullptr);
+    h->Sumw2();
+    h->GetXaxis()->SetTitle(axis->GetTitle());
+    h->GetYaxis()->SetTitle(master.GetYaxis()->GetTitle());
+
+    const int nBins = h->GetNbinsX();
+    double *contents = h->GetArray();
+    double *errors2  = h->GetSumw2()->GetArray();
+    for (int bin = 0; bin <= axis->GetNbins() + 1; ++bin) {
+        const int target = bin == 0                    ? 0
+                         : bin == axis->GetNbins() + 1 ? nBins + 1
+                         : h->FindFixBin(axis->GetBinCenter(bin));
+        const double error = master.GetBinError(bin);
+        contents[target] += master.GetBinContent(bin);
+        errors2[target]  += error * error;
+    }
+
+    if (view.perWidth)
+        for (int bin = 1; bin <= nBins; ++bin) {
+            const double width = h->GetBinWidth(bin);
+            contents[bin] /= width;
+            errors2[bin]  /= width * width;
+        }
+    h->SetEntries(master.GetEntries());
+    return h;
+}
+
+#endif //HISTVIEW_H
@@ -0,0 +1,57 @@
+#ifndef INPUTHASH_H
+#define INPUTHASH_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "TH1.h"
+
+// 64-bit FNV-1a hash used to detect if the inputs of a plot or fit have changed between runs
+class inputHash {
+public:
+    inputHash& add(const void* data, size_t size) {
+        auto *bytes = static_cast<const unsigned char*>(data);
+        for (size_t k = 0; k < size; ++k) {
+            value ^= bytes[k];
+            value *= 0x100000001b3ULL;
+        }
+        return *this;
+    }
+
+    inputHash& add(double v)             { return add(&v, sizeof(v)); }
+    inputHash& add(int v)                { return add(&v, sizeof(v)); }
+    inputHash& add(bool v)               { return add(int(v)); }
+    inputHash& add(const std::string& s) { add(int(s.size())); return add(s.data(), s.size()); }
+
+    // Binning, contents and errors of a histogram (including underflow and overflow).
+    // A missing histogram is hashed as an empty marker, so it differs from an empty one
+    inputHash& add(const TH1* h) {
+        if (!h)
+            return add(-1);
+        const int nBins = h->GetNbinsX();
+        add(nBins);
+        for (int bin = 1; bin <= nBins + 1; ++bin)
+            add(h->GetXaxis()->GetBinLowEdge(bin));
+        for (int bin = 0; bin <= nBins + 1; ++bin) {
+            add(h->GetBinContent(bin));
+            add(h->GetBinError(bin));
+        }
+        return *this;
+    }
+
+    uint64_t get() const { return value; }
+
+    std::string str() const { return hex(value); }
+
+    static std::string hex(uint64_t hash) {
+        char buffer[17];
+        snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) hash);
+        return buffer;
+    }
+
+private:
+    uint64_t value = 0xcbf29ce484222325ULL;
+};
+
+#endif //INPUTHASH_H
@@ -0,0 +1,57 @@
+#ifndef NORMALIZATION_H
+#define NORMALIZATION_H
+
+
+#include <algorithm>
+#include <vector>
+#include "TH1.h"
+
+// Per-bin inputs of the normalization of one (sample, mass region), indexed like the histogram cells
+// (0 is the underflow): the data, the weighted sum of the datasets being normalized (fit) and the
+// weighted sum of every dataset (sum)
+struct normBuffers {
+    std::vector<double> data, fit, sum;
+
+    void reset(size_t nCells) {
+        data.assign(nCells, 0);
+        fit .assign(nCells, 0);
+        sum .assign(nCells, 0);
+    }
+
+    // Scale factor of the normalized datasets that makes the simulation match the data in a bin
+    double factor(int bin) const { return (fit[bin] + data[bin] - sum[bin]) / fit[bin]; }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Copy the contents of every cell of a histogram into a contiguous buffer. TH1D/TH1F are copied
+// straight from their storage instead of calling GetBinContent once per bin
+inline void binContents(const TH1* h, std::vector<double>& out) {
+    const int nCells = h->GetNcells();
+    out.resize(nCells);
+    if (auto *hd = dynamic_cast<const TH1D*>(h))
+        std::copy(hd->GetArray(), hd->GetArray() + nCells, out.begin());
+    else if (auto *hf = dynamic_cast<const TH1F*>(h))
+        std::copy(hf->GetArray(), hf->GetArray() + nCells, out.begin());
+    else
+        for (int cell = 0; cell < nCells; ++cell)
+            out[cell] = h->GetBinContent(cell);
+}
+
+// out += weight * in, over contiguous buffers so the loop is vectorized by the compiler
+inline void addScaled(std::vector<double>& out, const std::vector<double>& in, double weight) {
+    const size_t n = std::min(out.size(), in.size());
+    double *__restrict o = out.data();
+    const double *__restrict i = in.data();
+    for (size_t k = 0; k < n; ++k)
+        o[k] += weight * i[k];
+}
+
+// Add the unweighted contents of one dataset to the sums, with its weight
+inline void addTemplate(normBuffers& buffers, const std::vector<double>& contents, double weight, bool used) {
+    addScaled(buffers.sum, contents, weight);
+    if (used)
+        addScaled(buffers.fit, contents, weight);
+}
+
+#endif //NORMALIZATION_H
@@ -0,0 +1,206 @@
+#ifndef PERFREPORT_H
+#define PERFREPORT_H
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include "TSystem.h"
+
+// Time and memory spent in the stages of a run (file open, histogram reads, scaling, drawing, saving,
+// fits...), aggregated per (stage, sample, mass region). Instrumentation is off unless the PERF_REPORT
+// environment variable is set, and then every entry point writes a JSON report to
+// "$PERF_REPORT<entry point>.json" when it ends (e.g. PERF_REPORT=perf/ gives perf/Graph.json)
+class perfReport {
+public:
+    struct stat {
+        long   count      = 0;
+        double seconds    = 0;
+        double maxSeconds = 0;
+        long   maxRssKB   = 0;
+    };
+    using key = std::tuple<std::string, std::string, std::string>;
+
+    static perfReport& global() {
+        static perfReport report;
+        return report;
+    }
+
+    bool enabled() const { return active; }
+
+    // Start a run of an entry point. Nested entry points are part of the outer run
+    void begin(const std::string& entry) {
+        if (depth++ > 0)
+            return;
+        const char *prefix = std::getenv("PERF_REPORT");
+        active = prefix != nullptr;
+        if (!active)
+            return;
+        path  = std::string(prefix) + entry + ".json";
+        name  = entry;
+        start = std::chrono::steady_clock::now();
+        stats.clear();
+    }
+
+    // End the run and write the report
+    void end() {
+        if (--depth > 0 || !active)
+            return;
+        const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        write(wall);
+        active = false;
+    }
+
+    void record(const std::string& stage, double seconds) {
+        const long rss = residentKB();
+        std::lock_guard<std::mutex> lock(mutex);
+        stat &s = stats[key(stage, context().first, context().second)];
+        ++s.count;
+        s.seconds   += seconds;
+        s.maxSeconds = std::max(s.maxSeconds, seconds);
+        s.maxRssKB   = std::max(s.maxRssKB, rss);
+    }
+
+    // (sample, mass region) the stages of the calling thread are attributed to
+    static std::pair<std::string, std::string>& context() {
+        static thread_local std::pair<std::string, std::string> current;
+        return current;
+    }
+
+    // Worker processes start from empty statistics (not the ones of the parent before the fork), save
+    // them to a fragment file, and the parent merges the fragments once the workers end
+    void startWorker() { stats.clear(); }
+
+    std::string fragment(unsigned worker) const { return path + ".worker" + std::to_string(worker); }
+
+    void saveFragment(unsigned worker) const {
+        if (!active)
+            return;
+        std::ofstream out(fragment(worker));
+        for (const auto & entry : stats)
+            out << std::get<0>(entry.first) << "\t" << std::get<1>(entry.first) << "\t" << std::get<2>(entry.first)
+                << "\t" << entry.second.count << "\t" << entry.second.seconds << "\t" << entry.second.maxSeconds
+                << "\t" << entry.second.maxRssKB << "\n";
+    }
+
+    void mergeFragments(unsigned nWorkers) {
+        if (!active)
+            return;
+        for (unsigned worker = 0; worker < nWorkers; ++worker) {
+            std::ifstream in(fragment(worker));
+            std::string line;
+            while (std::getline(in, line)) {
+                std::istringstream fields(line);
+                std::string stage, sample, mass, count, seconds, maxSeconds, maxRss;
+                std::getline(fields, stage, '\t');
+                std::getline(fields, sample, '\t');
+                std::getline(fields, mass, '\t');
+                fields >> count >> seconds >> maxSeconds >> maxRss;
+                if (!fields) continue;
+                stat &s = stats[key(stage, sample, mass)];
+                s.count     += std::stol(count);
+                s.seconds   += std::stod(seconds);
+                s.maxSeconds = std::max(s.maxSeconds, std::stod(maxSeconds));
+                s.maxRssKB   = std::max(s.maxRssKB, std::stol(maxRss));
+            }
+            std::remove(fragment(worker).c_str());
+        }
+    }
+
+    static long residentKB() {
+        ProcInfo_t info;
+        return gSystem->GetProcInfo(&info) == 0 ? info.fMemResident : 0;
+    }
+
+private:
+    static std::string quoted(const std::string& text) {
+        std::string out = "\"";
+        for (char ch : text) {
+            if (ch == '"' || ch == '\\') out += '\\';
+            out += ch;
+        }
+        return out + "\"";
+    }
+
+    void write(double wall) const {
+        std::ofstream out(path);
+        long peak = 0;
+        for (const auto & entry : stats)
+            peak = std::max(peak, entry.second.maxRssKB);
+        out << "{\n  \"entry\": " << quoted(name) << ",\n  \"wallSeconds\": " << wall
+            << ",\n  \"peakRssKB\": " << std::max(peak, residentKB()) << ",\n  \"stages\": [";
+        bool first = true;
+        for (const auto & entry : stats) {
+            out << (first ? "\n" : ",\n") << "    {\"stage\": " << quoted(std::get<0>(entry.first))
+                << ", \"sample\": " << quoted(std::get<1>(entry.first)) << ", \"mass\": " << quoted(std::get<2>(entry.first))
+                << ", \"count\": " << entry.second.count << ", \"seconds\": " << entry.second.seconds
+                << ", \"maxSeconds\": " << entry.second.maxSeconds << ", \"maxRssKB\": " << entry.second.maxRssKB << "}";
+            first = false;
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    bool        active = false;
+    int         depth  = 0;
+    std::string path, name;
+    std::chrono::steady_clock::time_point start;
+    std::map<key, stat> stats;
+    std::mutex  mutex;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Time the enclosing scope as one occurrence of a stage. Costs a single flag test when disabled
+class perfTimer {
+public:
+    explicit perfTimer(const char* stage) : stage(stage), on(perfReport::global().enabled()) {
+        if (on) start = std::chrono::steady_clock::now();
+    }
+    ~perfTimer() { stop(); }
+
+    // End the stage before the end of the scope
+    void stop() {
+        if (on)
+            perfReport::global().record(stage, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        on = false;
+    }
+    perfTimer(const perfTimer&) = delete;
+    perfTimer& operator=(const perfTimer&) = delete;
+
+private:
+    const char *stage;
+    bool        on;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Attribute the stages of the enclosing scope to a (sample, mass region)
+class perfContext {
+public:
+    perfContext(const std::string& sample, const std::string& mass) : previous(perfReport::context()) {
+        perfReport::context() = {sample, mass};
+    }
+    ~perfContext() { perfReport::context() = previous; }
+    perfContext(const perfContext&) = delete;
+    perfContext& operator=(const perfContext&) = delete;
+
+private:
+    std::pair<std::string, std::string> previous;
+};
+
+// Instrumented run of an entry point: the report is written when it goes out of scope
+class perfRun {
+public:
+    explicit perfRun(const std::string& entry) { perfReport::global().begin(entry); }
+    ~perfRun() { perfReport::global().end(); }
+    perfRun(const perfRun&) = delete;
+    perfRun& operator=(const perfRun&) = delete;
+};
+
+#endif //PERFREPORT_H
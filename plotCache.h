@@ -0,0 +1,40 @@
+#ifndef PLOTCACHE_H
+#define PLOTCACHE_H
+
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+
+// Record of the input hash used for every plot of a previous run, stored as "<plot> <hash>" lines.
+// A plot only needs to be drawn again if its current input hash differs from the recorded one
+class plotCache {
+public:
+    explicit plotCache(std::string path) : path(std::move(path)) {
+        std::ifstream in(this->path);
+        std::string plot, hash;
+        while (in >> plot >> hash)
+            entries[plot] = hash;
+    }
+
+    bool upToDate(const std::string& plot, const std::string& hash) const {
+        auto it = entries.find(plot);
+        return it != entries.end() && it->second == hash;
+    }
+
+    void update(const std::string& plot, const std::string& hash) { entries[plot] = hash; }
+
+    bool save() const {
+        std::ofstream out(path);
+        for (const auto & entry : entries)
+            out << entry.first << " " << entry.second << "\n";
+        return bool(out);
+    }
+
+private:
+    std::string path;
+    std::map<std::string, std::string> entries;
+};
+
+#endif //PLOTCACHE_H
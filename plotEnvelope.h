@@ -0,0 +1,84 @@
+#ifndef PLOTENVELOPE_H
+#define PLOTENVELOPE_H
+
+
+#include <cfloat>
+#include <vector>
+#include "TH1.h"
+
+#include "normalization.h"
+
+// Ranges of a plot accumulated in one pass over its histograms as they are added to the stack: the
+// integrals, the stacked sum and the data maximum plus its error. They give exactly the values of
+// THStack::GetMaximum()/GetMinimum() and TH1::GetMaximum()/GetMaximumBin() on the full axis range,
+// without building the stack or scanning the bins again before drawing
+class plotEnvelope {
+public:
+    void setData(const TH1& data) {
+        binContents(&data, contents);
+        nBins = data.GetNbinsX();
+        dataIntegral = 0;
+        dataMax = -FLT_MAX;
+        int maxBin = 1;
+        for (int bin = 1; bin <= nBins; ++bin) {
+            dataIntegral += contents[bin];
+            if (contents[bin] > dataMax) {
+                dataMax = contents[bin];
+                maxBin = bin;
+            }
+        }
+        dataError = data.GetBinError(maxBin);
+        total.assign(contents.size(), 0.);
+        nLayers = 0;
+    }
+
+    // Add a histogram on top of the stack. Returns false, leaving the stack untouched, if it is empty
+    bool addLayer(const TH1& h) {
+        binContents(&h, contents);
+        double integral = 0;
+        for (int bin = 1; bin <= h.GetNbinsX(); ++bin)
+            integral += contents[bin];
+        if (integral == 0)
+            return false;
+        addScaled(total, contents, 1.);
+        ++nLayers;
+        return true;
+    }
+
+    bool hasData() const { return dataIntegral != 0; }
+
+    // Maximum of the data with the error of its highest bin, times the margin used by the plots
+    double dataTop() const { return dataMax + dataError * 1.3; }
+
+    // Maximum and minimum of the stacked sum, 0 for an empty stack. On a logarithmic pad a minimum
+    // <= 0 is replaced by the smallest positive bin, like THStack::GetMinimum() does
+    double stackMaximum() const {
+        if (nLayers == 0)
+            return 0;
+        double maximum = -FLT_MAX;
+        for (int bin = 1; bin <= nBins; ++bin)
+            if (total[bin] > maximum) maximum = total[bin];
+        return maximum;
+    }
+
+    double stackMinimum(bool logy) const {
+        if (nLayers == 0)
+            return 0;
+        double minimum = FLT_MAX;
+        for (int bin = 1; bin <= nBins; ++bin)
+            if (total[bin] < minimum) minimum = total[bin];
+        if (minimum <= 0 && logy) {
+            minimum = FLT_MAX;
+            for (int bin = 1; bin <= nBins; ++bin)
+                if (total[bin] < minimum && total[bin] > 0) minimum = total[bin];
+        }
+        return minimum;
+    }
+
+private:
+    std::vector<double> contents, total;
+    int    nBins = 0, nLayers = 0;
+    double dataIntegral = 0, dataMax = 0, dataError = 0;
+};
+
+#endif //PLOTENVELOPE_H
@@ -0,0 +1,225 @@
+#ifndef PLOTOUTPUT_H
+#define PLOTOUTPUT_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <png.h>
+#include "TCanvas.h"
+#include "TImage.h"
+#include "TROOT.h"
+#include "TSystem.h"
+#include "TError.h"
+
+#include "perfReport.h"
+
+enum class plotFormat { png, svg, pdf };
+
+inline bool parsePlotFormat(const std::string& name, plotFormat& format) {
+    if      (name == "png") format = plotFormat::png;
+    else if (name == "svg") format = plotFormat::svg;
+    else if (name == "pdf") format = plotFormat::pdf;
+    else return false;
+    return true;
+}
+
+inline const char* plotExtension(plotFormat format) {
+    switch (format) {
+        case plotFormat::svg: return "svg";
+        case plotFormat::pdf: return "pdf";
+        default:              return "png";
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Destination of the plots of a Graph() run:
+//  - png: the canvas is rasterized in the calling thread (the same TImage::FromPad path SaveAs uses)
+//    and its pixels are copied out of the image, which is deleted right away. A background thread
+//    encodes the copies with libpng, so the next plot can be composed meanwhile. TImage is only ever
+//    used by the calling thread, since libAfterImage is not reentrant. At most queueDepth images wait
+//    in memory
+//  - svg: one file per plot, written directly
+//  - pdf: one multi-page file per mass region, outputFolder/<mass>.pdf, with one page per sample. The
+//    plots of a mass region must be saved one after the other
+// A previous version of a file is removed before it is written, so a plot that couldn't be written is
+// reported by finish() instead of being silently left over from an earlier run
+class plotOutput {
+public:
+    plotOutput(std::string outputFolder, plotFormat format, size_t queueDepth = 4)
+        : folder(std::move(outputFolder)), format(format), queueDepth(queueDepth) {
+        if (format == plotFormat::png) {
+            ROOT::EnableThreadSafety();
+            writer = std::thread([this] { writeLoop(); });
+        }
+    }
+    plotOutput(const plotOutput&) = delete;
+    plotOutput& operator=(const plotOutput&) = delete;
+
+    ~plotOutput() { finish(); }
+
+    // Path of a plot (of its mass region file for pdf)
+    std::string path(const std::string& mass, const std::string& name) const {
+        if (format == plotFormat::pdf)
+            return folder + mass + ".pdf";
+        return folder + mass + "/" + name + "." + plotExtension(format);
+    }
+
+    void save(TCanvas* c, const std::string& mass, const std::string& name) {
+        perfTimer timer("save");
+        const std::string file = path(mass, name);
+        if (file != pdfFile)
+            gSystem->Unlink(file.c_str());
+        switch (format) {
+            case plotFormat::png: {
+                pngJob job{file, perfReport::context()};
+                {
+                    perfTimer rasterize("rasterize");
+                    c->Update();
+                    std::unique_ptr<TImage> image(TImage::Create());
+                    image->FromPad(c);
+                    const UInt_t *argb = image->GetArgbArray();
+                    if (!argb) {
+                        Error("plotOutput", "Cannot rasterize %s", file.c_str());
+                        written = false;
+                        break;
+                    }
+                    job.width  = image->GetWidth();
+                    job.height = image->GetHeight();
+                    job.argb.assign(argb, argb + size_t(job.width) * job.height);
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                space.wait(lock, [this] { return queue.size() < queueDepth; });
+                queue.push_back(std::move(job));
+                ready.notify_one();
+                break;
+            }
+            case plotFormat::svg:
+                c->SaveAs(file.c_str());
+                verify(file);
+                break;
+            case plotFormat::pdf:
+                if (file != pdfFile) {
+                    closePdf();
+                    c->Print((file + "[").c_str());
+                    pdfFile   = file;
+                    pdfCanvas = c;
+                }
+                c->Print(file.c_str(), ("Title:" + name).c_str());
+                break;
+        }
+    }
+
+    // Remove the previous output of a plot that has nothing to draw, so it doesn't outlive its inputs.
+    // A pdf that is being written already lacks the page
+    void discard(const std::string& mass, const std::string& name) {
+        const std::string file = path(mass, name);
+        if (file != pdfFile)
+            gSystem->Unlink(file.c_str());
+    }
+
+    // Close the open pdf and wait until every queued image is written. Must be called before the
+    // canvas of a pdf is deleted. Returns false if any plot couldn't be written
+    bool finish() {
+        closePdf();
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+            }
+            ready.notify_one();
+            writer.join();
+        }
+        return written;
+    }
+
+private:
+    // Pixels (0xAARRGGBB, row by row from the top) waiting to be encoded, with the (sample, mass region)
+    // they are attributed to
+    struct pngJob {
+        std::string                         file;
+        std::pair<std::string, std::string> context;
+        unsigned                            width = 0, height = 0;
+        std::vector<uint32_t>               argb;
+    };
+
+    void closePdf() {
+        if (pdfFile.empty())
+            return;
+        pdfCanvas->Print((pdfFile + "]").c_str());
+        verify(pdfFile);
+        pdfFile.clear();
+        pdfCanvas = nullptr;
+    }
+
+    // Encode an opaque RGB png with the libpng simplified API, which keeps all its state in the png_image
+    bool writePng(const pngJob& job) {
+        std::vector<png_byte> rgb(job.argb.size() * 3);
+        for (size_t k = 0; k < job.argb.size(); ++k) {
+            rgb[3 * k]     = png_byte(job.argb[k] >> 16);
+            rgb[3 * k + 1] = png_byte(job.argb[k] >> 8);
+            rgb[3 * k + 2] = png_byte(job.argb[k]);
+        }
+        png_image png{};
+        png.version = PNG_IMAGE_VERSION;
+        png.width   = job.width;
+        png.height  = job.height;
+        png.format  = PNG_FORMAT_RGB;
+        if (png_image_write_to_file(&png, job.file.c_str(), 0, rgb.data(), 0, nullptr))
+            return true;
+        Error("plotOutput", "Cannot write %s: %s", job.file.c_str(), png.message);
+        written = false;
+        return false;
+    }
+
+    bool verify(const std::string& file) {
+        if (!gSystem->AccessPathName(file.c_str()))
+            return true;
+        Error("plotOutput", "Cannot write %s", file.c_str());
+        written = false;
+        return false;
+    }
+
+    void writeLoop() {
+        while (true) {
+            pngJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return done || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            space.notify_one();
+            perfContext context(job.context.first, job.context.second);
+            perfTimer timer("encode");
+            if (writePng(job) && verify(job.file))
+                Info("plotOutput", "png file %s has been created", job.file.c_str());
+        }
+    }
+
+    std::string folder;
+    plotFormat  format;
+    size_t      queueDepth;
+
+    std::string pdfFile;
+    TCanvas    *pdfCanvas = nullptr;
+    std::atomic<bool> written{true};
+
+    std::thread                                                     writer;
+    std::mutex                                                      mutex;
+    std::condition_variable                                         ready, space;
+    std::deque<pngJob>                                              queue;
+    bool                                                            done = false;
+};
+
+#endif //PLOTOUTPUT_H
@@ -0,0 +1,46 @@
+#ifndef PLOTSCOPE_H
+#define PLOTSCOPE_H
+
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include "TObject.h"
+#include "TVirtualPad.h"
+
+// Owner of every ROOT object created for a single plot (legend, stack, histograms). When the scope
+// ends the pad is cleared and the objects are deleted in reverse creation order, so nothing created
+// for one plot survives into the next one
+class plotScope {
+public:
+    explicit plotScope(TVirtualPad* pad = nullptr) : pad(pad) {}
+    plotScope(const plotScope&) = delete;
+    plotScope& operator=(const plotScope&) = delete;
+
+    ~plotScope() {
+        if (pad)
+            pad->Clear();
+        while (!objects.empty())
+            objects.pop_back();
+    }
+
+    // Create an object owned by the scope
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        return adopt(new T(std::forward<Args>(args)...));
+    }
+
+    // Take ownership of an already created object (nullptr is ignored)
+    template <class T>
+    T* adopt(T* obj) {
+        if (obj)
+            objects.emplace_back(obj);
+        return obj;
+    }
+
+private:
+    TVirtualPad* pad;
+    std::vector<std::unique_ptr<TObject>> objects;
+};
+
+#endif //PLOTSCOPE_H
@@ -0,0 +1,34 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <TROOT.h>
+
+#include "entryPoints.h"
+
+// Usage: bench [workFolder] [nBins] [scale] [nWorkers] [nRepeats] [seed] [configFile]
+//        bench --synth [outputFile] [nBins] [scale] [seed] [configFile]
+int main(int argc, char** argv) {
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "Usage: " << argv[0] << " [workFolder] [nBins] [scale] [nWorkers] [nRepeats] [seed] [configFile]\n"
+                  << "       " << argv[0] << " --synth [outputFile] [nBins] [scale] [seed] [configFile]" << std::endl;
+        return 0;
+    }
+    gROOT->SetBatch(true);
+
+    // Synthetic data file only
+    if (argc > 1 && std::string(argv[1]) == "--synth") {
+        return Synthesize(argc > 2 ? argv[2] : "dataFile.root",
+                          argc > 3 ? std::atoi(argv[3]) : 50,
+                          argc > 4 ? std::atof(argv[4]) : 1e4,
+                          argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 1234,
+                          argc > 6 ? argv[6] : "analysis.cfg") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    return Benchmark(argc > 1 ? argv[1] : "bench/",
+                     argc > 2 ? std::atoi(argv[2]) : 50,
+                     argc > 3 ? std::atof(argv[3]) : 1e4,
+                     argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 1,
+                     argc > 5 ? std::atoi(argv[5]) : 1,
+                     argc > 6 ? std::strtoul(argv[6], nullptr, 10) : 1234,
+                     argc > 7 ? argv[7] : "analysis.cfg") ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,50 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <TROOT.h>
+
+#include "entryPoints.h"
+
+// Usage: fit [configFile] [cacheFile]
+//        fit --scan [datafile] [outputFile] [nWorkers] [configFile] [cacheFile]
+//        fit --toys [nToys] [nWorkers] [seed] [outputFile] [configFile] [cacheFile]
+//        fit --template [outputFile] [configFile]
+// Without a cacheFile the fits are not warm-started from, nor recorded in, a fit cache (see fitCache.h)
+int main(int argc, char** argv) {
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "Usage: " << argv[0] << " [configFile] [cacheFile]\n"
+                  << "       " << argv[0] << " --scan [datafile] [outputFile] [nWorkers] [configFile] [cacheFile]\n"
+                  << "       " << argv[0] << " --toys [nToys] [nWorkers] [seed] [outputFile] [configFile] [cacheFile]\n"
+                  << "       " << argv[0] << " --template [outputFile] [configFile]" << std::endl;
+        return 0;
+    }
+    gROOT->SetBatch(true);
+
+    // Fit campaign over every PtPair sample, mass region and weight variation
+    if (argc > 1 && std::string(argv[1]) == "--scan") {
+        return FitScan(argc > 2 ? argv[2] : "dataFile.root",
+                       argc > 3 ? argv[3] : "fitScan.tsv",
+                       argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 4,
+                       argc > 5 ? argv[5] : "analysis.cfg",
+                       argc > 6 ? argv[6] : "") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Toy study of the selected fit
+    if (argc > 1 && std::string(argv[1]) == "--toys") {
+        return FitToys(argc > 2 ? std::atoi(argv[2]) : 10000,
+                       argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4,
+                       argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 1234,
+                       argc > 5 ? argv[5] : "fitToys.tsv",
+                       argc > 6 ? argv[6] : "analysis.cfg",
+                       argc > 7 ? argv[7] : "") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Template fit with one free normalization per dataset group
+    if (argc > 1 && std::string(argv[1]) == "--template") {
+        return TemplateFit(argc > 2 ? argv[2] : "templateFit.tsv",
+                           argc > 3 ? argv[3] : "analysis.cfg") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    return Fit(argc > 1 ? argv[1] : "analysis.cfg",
+               argc > 2 ? argv[2] : "") ? EXIT_SUCCESS : EXIT_FAILURE;
+}
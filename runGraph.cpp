@@ -0,0 +1,24 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <TROOT.h>
+
+#include "entryPoints.h"
+
+// Usage: graph [outputFolder] [datafile] [nWorkers] [incremental] [configFile] [stacked] [png|svg|pdf]
+int main(int argc, char** argv) {
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "Usage: " << argv[0] << " [outputFolder] [datafile] [nWorkers] [incremental] [configFile] [stacked] [png|svg|pdf]" << std::endl;
+        return 0;
+    }
+    gROOT->SetBatch(true);
+
+    return Graph(argc > 1 ? argv[1] : "./Plots/",
+                 argc > 2 ? argv[2] : "dataFile.root",
+                 argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1,
+                 argc > 4 && std::atoi(argv[4]) != 0,
+                 argc > 5 ? argv[5] : "analysis.cfg",
+                 argc > 6 && std::atoi(argv[6]) != 0,
+                 argc > 7 ? argv[7] : "png",
+                 true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
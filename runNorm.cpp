@@ -0,0 +1,39 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <TROOT.h>
+
+#include "entryPoints.h"
+
+// Usage: norm [datafile] [configFile]
+//        norm --all [datafile] [outputFile] [configFile] [stacked]
+//        norm --syst [datafile] [yieldsFile] [factorsFile] [fitFile] [configFile]
+int main(int argc, char** argv) {
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "Usage: " << argv[0] << " [datafile] [configFile]\n"
+                  << "       " << argv[0] << " --all [datafile] [outputFile] [configFile] [stacked]\n"
+                  << "       " << argv[0] << " --syst [datafile] [yieldsFile] [factorsFile] [fitFile] [configFile]" << std::endl;
+        return 0;
+    }
+    gROOT->SetBatch(true);
+
+    // Batch normalization of every sample, mass region and bin
+    if (argc > 1 && std::string(argv[1]) == "--all") {
+        return NormAll(argc > 2 ? argv[2] : "dataFile.root",
+                       argc > 3 ? argv[3] : "normFactors.tsv",
+                       argc > 4 ? argv[4] : "analysis.cfg",
+                       argc > 5 && std::atoi(argv[5]) != 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Yields, normalization factors and fit inputs of every weight variation
+    if (argc > 1 && std::string(argv[1]) == "--syst") {
+        return Systematics(argc > 2 ? argv[2] : "dataFile.root",
+                           argc > 3 ? argv[3] : "systYields.tsv",
+                           argc > 4 ? argv[4] : "systFactors.tsv",
+                           argc > 5 ? argv[5] : "systFitInputs.root",
+                           argc > 6 ? argv[6] : "analysis.cfg") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    return Norm(argc > 1 ? argv[1] : "dataFile.root",
+                argc > 2 ? argv[2] : "analysis.cfg") ? EXIT_SUCCESS : EXIT_FAILURE;
+}
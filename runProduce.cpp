@@ -0,0 +1,25 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "entryPoints.h"
+
+// Usage: produce [outputFile] [nThreads] [configFile]
+//        produce --export [datafile] [outputFile]
+int main(int argc, char** argv) {
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "Usage: " << argv[0] << " [outputFile] [nThreads] [configFile]\n"
+                  << "       " << argv[0] << " --export [datafile] [outputFile]" << std::endl;
+        return 0;
+    }
+
+    // Memory-mappable export of a data file
+    if (argc > 1 && std::string(argv[1]) == "--export") {
+        return Export(argc > 2 ? argv[2] : "dataFile.root",
+                      argc > 3 ? argv[3] : "") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    return Produce(argc > 1 ? argv[1] : "dataFile.root",
+                   argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0,
+                   argc > 3 ? argv[3] : "analysis.cfg") ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,243 @@
+#ifndef STACKCACHE_H
+#define STACKCACHE_H
+
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TNamed.h"
+#include "TSystem.h"
+#include "TError.h"
+
+#include "config.h"
+#include "histProvider.h"
+#include "inputHash.h"
+#include "perfReport.h"
+
+// One histogram of a pre-stacked plot: a dataset group of the configuration, drawn with the color of its
+// first dataset and the legend of the group (its name if it has none), or a dataset outside any group,
+// drawn like in the regular plots
+struct stackComponent {
+    std::string              name;
+    Color_t                  color = 0;
+    std::string              legend;
+    std::vector<std::string> datasets;
+};
+
+// Components in stack order, i.e. in the order their first dataset is listed in the configuration
+inline std::vector<stackComponent> stackComponents(const analysisConfig& cfg) {
+    std::map<std::string, const datasetGroup*> groupOf;
+    for (const auto & group : cfg.groups)
+        for (const auto & name : group.datasets)
+            groupOf[name] = &group;
+
+    std::vector<stackComponent> components;
+    std::map<const datasetGroup*, size_t> emitted;
+    for (const auto & data : cfg.datasets) {
+        auto group = groupOf.find(data.name);
+        if (group == groupOf.end()) {
+            components.push_back({data.name, data.color, data.legend, {data.name}});
+            continue;
+        }
+        auto it = emitted.find(group->second);
+        if (it == emitted.end()) {
+            it = emitted.emplace(group->second, components.size()).first;
+            const datasetGroup &g = *group->second;
+            components.push_back({g.name, data.color, g.legend.empty() ? g.name : g.legend, {}});
+        }
+        components[it->second].datasets.push_back(data.name);
+    }
+    return components;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Derived file with, for every (sample, mass region), the data and the weighted sum of every stack
+// component packed in one TH2D: x is the binning of the sample (with underflow and overflow) and row
+// y = 1 is the data, row y = k + 2 the component k. A plot is then a single read. The file is stamped
+// with the weights, the components and the names, sizes and dates of the data files, and is rebuilt
+// when it was made from anything else. It is built under a temporary name and renamed when complete, so
+// concurrent jobs never read a partial file
+class stackCache {
+public:
+    stackCache(const std::string& datafile, const analysisConfig& cfg)
+        : components(stackComponents(cfg)) {
+        std::vector<std::string> files;
+        if (!histCatalog::inputFiles(datafile, files))
+            return;
+        const std::string path = pathFor(files);
+        const std::string current = stamp(cfg, files);
+        if (!gSystem->AccessPathName(path.c_str())) {
+            file.reset(TFile::Open(path.c_str()));
+            if (file && !file->IsZombie()) {
+                std::unique_ptr<TNamed> saved(file->Get<TNamed>("stamp"));
+                if (saved && current == saved->GetTitle())
+                    return;
+            }
+            file.reset();
+        }
+        if (!build(datafile, cfg, path, current))
+            return;
+        file.reset(TFile::Open(path.c_str()));
+        if (file && file->IsZombie())
+            file.reset();
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    const std::vector<stackComponent>& stack() const { return components; }
+
+    // Packed histograms of a (sample, mass region), owned by the caller. nullptr if there is no data
+    TH2D* get(const std::string& sample, const std::string& mass) const {
+        perfTimer timer("read");
+        auto *packed = file->Get<TH2D>((sample + "_" + mass).c_str());
+        if (packed)
+            packed->SetDirectory(nullptr);
+        return packed;
+    }
+
+    // Unpack one row (0 for the data, k + 1 for component k) as a 1D histogram owned by the caller.
+    // The data row keeps the title and the number of entries of the original histogram
+    static TH1D* row(const TH2D& packed, int row, const std::string& name) {
+        const TAxis *axis = packed.GetXaxis();
+        auto *h = axis->GetXbins()->GetSize()
+                ? new TH1D(name.c_str(), packed.GetTitle(), axis->GetNbins(), axis->GetXbins()->GetArray())
+                : new TH1D(name.c_str(), packed.GetTitle(), axis->GetNbins(), axis->GetXmin(), axis->GetXmax());
+        h->SetDirectory(nullptr);
+        h->Sumw2();
+        h->GetXaxis()->SetTitle(axis->GetTitle());
+        for (int bin = 0; bin <= axis->GetNbins() + 1; ++bin) {
+            h->SetBinContent(bin, packed.GetBinContent(bin, row + 1));
+            h->SetBinError(bin, packed.GetBinError(bin, row + 1));
+        }
+        h->SetEntries(row == 0 ? packed.GetEntries() : h->Integral());
+        return h;
+    }
+
+    // Next to the data file, or for several files (see histCatalog.h) in the current directory, named
+    // after the hash of their list
+    static std::string pathFor(const std::vector<std::string>& files) {
+        if (files.size() != 1) {
+            inputHash hash;
+            for (const auto & file : files)
+                hash.add(file);
+            return "inputs_" + hash.str() + ".stack.root";
+        }
+        const std::string suffix = ".root";
+        std::string base = files[0];
+        if (base.size() > suffix.size() && base.compare(base.size() - suffix.size(), suffix.size(), suffix) == 0)
+            base.resize(base.size() - suffix.size());
+        return base + ".stack.root";
+    }
+
+    // Hash of everything the cache is made from, except the histograms themselves
+    static std::string stamp(const analysisConfig& cfg, const std::vector<std::string>& files) {
+        inputHash hash;
+        for (const auto & file : files) {
+            FileStat_t info;
+            hash.add(file);
+            if (gSystem->GetPathInfo(file.c_str(), info) == 0)
+                hash.add(double(info.fSize)).add(double(info.fMtime));
+        }
+        for (const auto & data : cfg.datasets)
+            hash.add(data.name).add(data.weight);
+        for (const auto & component : stackComponents(cfg)) {
+            hash.add(component.name);
+            for (const auto & name : component.datasets)
+                hash.add(name);
+        }
+        for (const auto & mass : cfg.massList)
+            hash.add(mass);
+        for (const auto & sample : cfg.samples) {
+            const sampleView &view = sample.second.view;
+            hash.add(sample.first).add(view.master).add(view.lo).add(view.hi).add(view.rebin).add(int(view.perWidth));
+            for (double edge : view.edges)
+                hash.add(edge);
+        }
+        return hash.str();
+    }
+
+private:
+    bool build(const std::string& datafile, const analysisConfig& cfg, const std::string& path,
+               const std::string& current) {
+        perfTimer timer("build stack cache");
+        histProvider provider(datafile.c_str());
+        if (!provider.isOpen())
+            return false;
+        provider.setViews(cfg.samples);
+        const std::string temporary = path + ".tmp." + std::to_string(gSystem->GetPid());
+        std::unique_ptr<TFile> out(TFile::Open(temporary.c_str(), "RECREATE"));
+        if (!out || out->IsZombie()) {
+            Error("stackCache", "Cannot create %s", temporary.c_str());
+            return false;
+        }
+        bool written = true;
+
+        std::map<std::string, double> weights;
+        for (const auto & data : cfg.datasets)
+            weights[data.name] = data.weight;
+
+        const int nRows = components.size() + 1;
+        for (const auto & sample : cfg.samples) {
+            for (const auto & mass : cfg.massList) {
+                auto data = provider.get(sample.first, mass, "data");
+                if (!data) continue;
+
+                const TAxis *axis = data->GetXaxis();
+                const std::string key = sample.first + "_" + mass;
+                std::unique_ptr<TH2D> packed(axis->GetXbins()->GetSize()
+                        ? new TH2D(key.c_str(), data->GetTitle(), axis->GetNbins(), axis->GetXbins()->GetArray(), nRows, 0, nRows)
+                        : new TH2D(key.c_str(), data->GetTitle(), axis->GetNbins(), axis->GetXmin(), axis->GetXmax(), nRows, 0, nRows));
+                packed->SetDirectory(nullptr);
+                packed->Sumw2();
+                packed->GetXaxis()->SetTitle(axis->GetTitle());
+                packed->GetYaxis()->SetBinLabel(1, "data");
+                fillRow(*packed, 0, *data);
+
+                for (size_t k = 0; k < components.size(); ++k) {
+                    packed->GetYaxis()->SetBinLabel(k + 2, components[k].name.c_str());
+                    for (const auto & name : components[k].datasets) {
+                        auto h = provider.get(sample.first, mass, name, weights[name]);
+                        if (!h) continue;
+                        if (h->GetNcells() != data->GetNcells()) {
+                            Warning("stackCache", "%s_%s_%s has a different binning than the data, skipping it",
+                                    sample.first.c_str(), mass.c_str(), name.c_str());
+                            continue;
+                        }
+                        fillRow(*packed, k + 1, *h);
+                    }
+                }
+                packed->SetEntries(data->GetEntries());
+                written &= out->WriteObject(packed.get(), key.c_str()) > 0;
+            }
+        }
+
+        TNamed stampObject("stamp", current.c_str());
+        written &= out->WriteObject(&stampObject, "stamp") > 0;
+        out->Close();
+        if (!written || gSystem->Rename(temporary.c_str(), path.c_str()) != 0) {
+            Error("stackCache", "Cannot write %s", path.c_str());
+            gSystem->Unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Add a histogram to a row of the packed histogram, summing the errors in quadrature
+    static void fillRow(TH2D& packed, int row, const TH1& h) {
+        for (int bin = 0; bin <= h.GetNbinsX() + 1; ++bin) {
+            const double error = std::hypot(packed.GetBinError(bin, row + 1), h.GetBinError(bin));
+            packed.SetBinContent(bin, row + 1, packed.GetBinContent(bin, row + 1) + h.GetBinContent(bin));
+            packed.SetBinError(bin, row + 1, error);
+        }
+    }
+
+    std::vector<stackComponent> components;
+    std::unique_ptr<TFile>      file;
+};
+
+#endif //STACKCACHE_H
@@ -0,0 +1,97 @@
+#ifndef SYNTHDATA_H
+#define SYNTHDATA_H
+
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH1D.h"
+#include "TRandom3.h"
+#include "TError.h"
+
+#include "config.h"
+
+// Shape and binning of the synthetic histograms of a sample: the booking of the sample if it has one,
+// nBins between 0 and 2 otherwise
+struct synthBinning {
+    int    nBins;
+    double lo, hi;
+};
+
+inline synthBinning synthBinningFor(const analysisConfig& cfg, const std::string& sample, int nBins) {
+    auto booking = cfg.bookings.find(sample);
+    if (booking != cfg.bookings.end() && booking->second.nBins > 0)
+        return {booking->second.nBins, booking->second.lo, booking->second.hi};
+    return {nBins, 0., 2.};
+}
+
+// Fraction of u*exp(-B*u*u), u in [0, 2], falling between u0 and u1
+inline double synthFraction(double slope, double u0, double u1) {
+    const double norm = 1. - std::exp(-4. * slope);
+    return (std::exp(-slope * u0 * u0) - std::exp(-slope * u1 * u1)) / norm;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Write a data file with the layout Produce() writes, "<sample>_<mass>_<dataset>" for every sample, mass
+// region and dataset of the configuration plus "<sample>_<mass>_data" (except for the views, which are
+// computed from their master when read), filled without any ntuple. Every
+// dataset follows x*exp(-B*x*x) over the sample range with its own B, its histograms have about scale
+// unweighted entries, and the data is a Poisson fluctuation of the weighted sum of the datasets, so
+// the plots, normalizations and fits behave like on real inputs. The same seed gives the same file
+inline int writeSyntheticData(const char* outputFile, const analysisConfig& cfg, int nBins, double scale,
+                              unsigned seed) {
+    TRandom3 random(seed);
+    std::vector<double> slopes;
+    for (size_t k = 0; k < cfg.datasets.size(); ++k)
+        slopes.push_back(random.Uniform(1., 8.));
+
+    std::unique_ptr<TFile> out(TFile::Open(outputFile, "RECREATE"));
+    if (!out || out->IsZombie()) {
+        Error("writeSyntheticData", "Cannot create %s", outputFile);
+        return 0;
+    }
+
+    int nWritten = 0;
+    for (const auto & sample : cfg.samples) {
+        if (sample.second.derived()) continue;
+        const synthBinning binning = synthBinningFor(cfg, sample.first, nBins);
+        for (const auto & mass : cfg.massList) {
+            const std::string prefix = sample.first + "_" + mass + "_";
+            TH1D data((prefix + "data").c_str(), sample.second.title.c_str(), binning.nBins, binning.lo, binning.hi);
+            data.SetDirectory(nullptr);
+            std::vector<double> expected(binning.nBins + 2, 0.);
+
+            for (size_t k = 0; k < cfg.datasets.size(); ++k) {
+                const dataStruct &simData = cfg.datasets[k];
+                TH1D h((prefix + simData.name).c_str(), sample.second.title.c_str(), binning.nBins, binning.lo, binning.hi);
+                h.SetDirectory(nullptr);
+                h.Sumw2();
+                for (int bin = 1; bin <= binning.nBins; ++bin) {
+                    const double u0 = 2. * (h.GetXaxis()->GetBinLowEdge(bin) - binning.lo) / (binning.hi - binning.lo);
+                    const double u1 = 2. * (h.GetXaxis()->GetBinUpEdge(bin) - binning.lo) / (binning.hi - binning.lo);
+                    const double mean = scale * synthFraction(slopes[k], u0, u1);
+                    const double count = random.Poisson(mean);
+                    h.SetBinContent(bin, count);
+                    h.SetBinError(bin, std::sqrt(count));
+                    expected[bin] += simData.weight * mean;
+                }
+                h.SetEntries(h.Integral());
+                out->WriteObject(&h, h.GetName());
+                ++nWritten;
+            }
+
+            for (int bin = 1; bin <= binning.nBins; ++bin)
+                data.SetBinContent(bin, random.Poisson(expected[bin]));
+            data.SetEntries(data.Integral());
+            out->WriteObject(&data, data.GetName());
+            ++nWritten;
+        }
+    }
+    out->Close();
+    return nWritten;
+}
+
+#endif //SYNTHDATA_H
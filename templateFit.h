@@ -0,0 +1,125 @@
+#ifndef TEMPLATEFIT_H
+#define TEMPLATEFIT_H
+
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Math/Factory.h"
+#include "Math/IFunction.h"
+#include "Math/Minimizer.h"
+#include "TError.h"
+
+// Binned Poisson likelihood of the data against a sum of templates with free normalizations mu:
+// nu_b = fixed_b + sum_t T_bt * mu_t. The templates are stored as one contiguous row-major
+// bins x templates matrix, so the expectation of a bin and its contribution to the gradient are
+// plain loops over a row. The value is the Baker-Cousins form sum_b nu_b - n_b + n_b*log(n_b/nu_b),
+// which has the same minimum as -log L and an error definition of 0.5
+class templateLikelihood : public ROOT::Math::IMultiGradFunction {
+public:
+    explicit templateLikelihood(unsigned nTemplates) : nTemplates(nTemplates) {}
+
+    // Add a bin with its data, the expectation of the datasets without a free normalization and the
+    // content of every template. Bins where every template is empty don't depend on mu and are dropped
+    void addBin(double data, double fixed, const double* row) {
+        if (std::all_of(row, row + nTemplates, [](double t) { return t == 0; }))
+            return;
+        matrix.insert(matrix.end(), row, row + nTemplates);
+        counts.push_back(data);
+        background.push_back(fixed);
+    }
+
+    size_t bins() const { return counts.size(); }
+    unsigned int NDim() const override { return nTemplates; }
+    ROOT::Math::IMultiGradFunction* Clone() const override { return new templateLikelihood(*this); }
+
+    void FdF(const double* mu, double& f, double* grad) const override {
+        f = 0;
+        std::fill(grad, grad + nTemplates, 0.);
+        for (size_t b = 0; b < counts.size(); ++b) {
+            const double *row = &matrix[b * nTemplates];
+            double nu = background[b];
+            for (unsigned t = 0; t < nTemplates; ++t)
+                nu += row[t] * mu[t];
+            nu = std::max(nu, minExpected);
+
+            const double n = counts[b];
+            f += nu - n + (n > 0 ? n * std::log(n / nu) : 0.);
+            const double w = 1 - n / nu;
+            for (unsigned t = 0; t < nTemplates; ++t)
+                grad[t] += row[t] * w;
+        }
+    }
+
+    void Gradient(const double* mu, double* grad) const override {
+        double f;
+        FdF(mu, f, grad);
+    }
+
+private:
+    double DoEval(const double* mu) const override {
+        double f = 0;
+        for (size_t b = 0; b < counts.size(); ++b) {
+            const double *row = &matrix[b * nTemplates];
+            double nu = background[b];
+            for (unsigned t = 0; t < nTemplates; ++t)
+                nu += row[t] * mu[t];
+            nu = std::max(nu, minExpected);
+            f += nu - counts[b] + (counts[b] > 0 ? counts[b] * std::log(counts[b] / nu) : 0.);
+        }
+        return f;
+    }
+
+    double DoDerivative(const double* mu, unsigned int coord) const override {
+        std::vector<double> grad(nTemplates);
+        Gradient(mu, grad.data());
+        return grad[coord];
+    }
+
+    // Floor of the expectation, so that negative weighted templates can't make the logarithm undefined
+    static constexpr double minExpected = 1e-9;
+
+    unsigned nTemplates;
+    std::vector<double> matrix;
+    std::vector<double> counts;
+    std::vector<double> background;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Normalizations of the templates, their errors and the minimizer status (0 when converged)
+struct templateResult {
+    std::vector<double> mu;
+    std::vector<double> error;
+    int    status = -1;
+    double nll    = 0;
+};
+
+// Minimize the likelihood with Minuit2, using its analytic gradient. Every normalization starts at 1
+// (the nominal weights) and is bounded from below by 0
+inline templateResult minimizeTemplates(const templateLikelihood& nll, const std::vector<std::string>& names) {
+    templateResult result;
+    std::unique_ptr<ROOT::Math::Minimizer> minimizer(ROOT::Math::Factory::CreateMinimizer("Minuit2", "Migrad"));
+    if (!minimizer) {
+        Error("minimizeTemplates", "Cannot create the Minuit2 minimizer");
+        return result;
+    }
+    minimizer->SetErrorDef(0.5);
+    minimizer->SetPrintLevel(0);
+    minimizer->SetStrategy(1);
+    minimizer->SetFunction(nll);
+    for (unsigned t = 0; t < nll.NDim(); ++t)
+        minimizer->SetLowerLimitedVariable(t, names[t], 1., 0.1, 0.);
+
+    minimizer->Minimize();
+    minimizer->Hesse();
+    result.status = minimizer->Status();
+    result.nll    = minimizer->MinValue();
+    result.mu.assign(minimizer->X(), minimizer->X() + nll.NDim());
+    result.error.assign(minimizer->Errors(), minimizer->Errors() + nll.NDim());
+    return result;
+}
+
+#endif //TEMPLATEFIT_H